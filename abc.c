@@ -17,18 +17,24 @@
 /****************************************************************************
  * Included Files
  ****************************************************************************/
+#include <errno.h>
 #include <float.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sys/param.h>
 
 #include <sys/types.h>
 #include <uv.h>
 
+#include "abc.h"
 #include "brightness.h"
 
+#include "default_curve.h"
 #include "display.h"
+#include "fixedpoint.h"
 #include "lightsensor.h"
 #include "persist.h"
 #include "private.h"
@@ -41,268 +47,522 @@
 #define LIGHTSENSOR_TOPIC_DEFAULT ORB_ID(sensor_light)
 
 #define INTERACTIVE_SHORT_TERM_MODEL_TIMEOUT (5 * 1000) /* 5 second */
+#define ADJUST_SESSION_TIMEOUT (60 * 1000) /* Gamma is held, 1 minute */
 
 #define MAX_GAMMA 2.0f
 
+#define USER_POINTS_MAX CONFIG_BRIGHTNESS_USER_POINTS
+#define USER_POINT_MERGE_RATIO 1.5f /* Closer lux replaces a user point */
+
+#define RESPONSE_TIME_MAX ((int)(UINT32_MAX / 1000)) /* ms, fits us in 32 bits */
+
+#ifdef CONFIG_LIGHTSENSOR_PERCEPTUAL_RAMP
+#define AUTO_RAMP_CURVE DISPLAY_RAMP_PERCEPTUAL
+#else
+#define AUTO_RAMP_CURVE DISPLAY_RAMP_LINEAR
+#endif
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+#define REAL_INTERPOLATE(spline, x) spline_interpolate_b16(spline, x)
+#else
+#define REAL_INTERPOLATE(spline, x) spline_interpolate(spline, x)
+#endif
+
 /* clang-format off */
 #define LIGHTSENSOR_JITTER_THRESHOLD    0.2f    /* lux change less than 20% regarded as jitter */
-#define LIGHTSENSOR_DRAMATIC_THRESHOLD  0.6f    /* lux change regarded as dramatic */
-#define LIGHTSENSOR_FILTER_FACTOR       0.1f    /* Exponential smoothing filter coefficient  */
-#define LIGHTSENSOR_STEADY_COUNT        10      /* After how much samples, result is treated as steady */
+#define LIGHTSENSOR_OUTLIER_TIME        600     /* Outliers for this long (ms) are a real change */
+#define LIGHTSENSOR_IDLE_NOISE          1       /* lux changes within this keep the idle rate */
 /* clang-format on */
 
 /****************************************************************************
  * Private Types
  ****************************************************************************/
 
+/* Lives as long as abc, so adjustments neither allocate nor close it. */
 struct short_term_model_s {
-    float lux;
+    real_t lux;
     int brightness;
+    bool active; /* User is adjusting, the timer runs */
 
     uv_timer_t timer;
 };
 
+/* Point learned from a user adjustment. */
+struct user_point_s {
+    int lux;
+    int brightness;
+    uint32_t seq; /* Adjustment that last set it, the oldest goes first */
+};
+
+/**
+ * Curve build on the work queue. The loop fills the inputs and leaves the
+ * job alone until its after work callback, the worker only writes the
+ * spare curve and the scratch arrays.
+ */
+struct curve_job_s {
+    uv_work_t work;
+    bool busy;    /* Queued or running */
+    bool pending; /* User points changed while busy */
+
+    /* Inputs, copied when queued */
+    struct user_point_s points[USER_POINTS_MAX];
+    int npoints;
+    real_t gamma;
+
+    /* Worker state */
+    real_t power_gamma; /* Gamma of 'gamma_power' */
+    struct spline_s *spline;
+    int curve_points;
+    int status;
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+    int updates; /* Curves built by update_curve() */
+#endif
+};
+
 struct abc_s {
     struct lightsensor_s *sensor;
     struct spline_s *spline;
     struct display_brightness_s *display;
 
     bool running;
+    int paused;     /* ABC_PAUSE_* reasons, sensor is off while any is set */
+    bool reacquire; /* Next new sample sets brightness at once */
     uv_loop_t *loop;
 
-    int target;         /* Current brightness target calculated by abc. */
-    float lux_last;     /* Last valid lux value received */
-    float lux_filtered; /* Latest filtered lux value */
-    float lux_set;      /* Lux used to set brightness */
-    int steady_count;   /* How much samples are steady. */
-    int dramatic_count; /* How much samples are dramatic. */
+    int target;      /* Current brightness target calculated by abc. */
+    real_t lux_last; /* Last valid lux value received */
+
+    struct lightsensor_filter_s filter; /* Lux filter chain */
+    struct abc_response_s response;
+
+    /* Adaptive sample rate, see sample_rate() */
+    real_t idle_lux;     /* Lux the flat period started at */
+    uint64_t idle_since; /* Start of the flat period in us, 0 if none */
 
-    float user_lux;
+    int user_lux;        /* Last user adjustment */
     int user_brightness;
 
+    /* Learned points, by lux and monotonic. Points of newer adjustments
+     * replace the ones they contradict or are close to. */
+    struct user_point_s user_points[USER_POINTS_MAX];
+    int nuser_points;
+    uint32_t user_seq;
+
     const float *default_curve_lux;
     const float *default_curve_power;
     int npoints;
 
+    /* Default curve with gamma applied, plus user points. It is built by
+     * a worker into the spare of two buffers with room for the extra
+     * points, then 'spline' is switched to it on the loop. They are
+     * allocated on first adjustment, until then the generated default
+     * curve is used as is. */
+    void *curve[2];
+    int curve_spare;    /* Buffer the next curve is built into */
+    size_t curve_size;
+    real_t gamma;       /* Gamma of 'spline' */
+    int curve_points;   /* Points in 'spline' */
+    real_t user_gamma;  /* Gamma of the last adjustment, for the next curve */
+    float *gamma_power; /* Default curve power with gamma applied */
+    float *curve_lux;   /* Scratch arrays to rebuild the curve */
+    float *curve_power;
+    struct curve_job_s job;
+
+    /* Adjustments keep 'user_gamma' until then, uv_now() in ms */
+    uint64_t session_end;
+
+    /* Adjustments made while the job was busy. Each is measured against
+     * the curve of the ones before it, so it waits for that build. */
+    struct user_point_s adjust[USER_POINTS_MAX];
+    int nadjust;
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+    bool nosave; /* Test controller, user points are not saved */
+#endif
+
     /* Interactive short term model */
-    struct short_term_model_s *interactive_model;
+    struct short_term_model_s interactive;
+
+    int closing; /* Callbacks deinit waits for before the free */
 };
 
 /****************************************************************************
  * Private Function Prototypes
  ****************************************************************************/
 static void abc_interactive_timeout(uv_timer_t *handle);
-static void interactive_timer_close_cb(uv_handle_t *handle);
+static void interactive_close_cb(uv_handle_t *handle);
 static void start_interactive_model(struct abc_s *abc, int target);
 static void stop_interactive_model(struct abc_s *abc);
+static void queue_curve(struct abc_s *abc);
+static void learn_user_point(struct abc_s *abc, int lux, int target);
+static void release_abc(struct abc_s *abc);
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
-/**
- * {lux, backlight}
- */
-static const float default_curve_lux[] = {
-    1,   2,   3,   5,   10,  20,   50,   100,  200,  300,
-    400, 500, 600, 700, 800, 1000, 1200, 1600, 2200, 3000,
+/* default_curve_lux, default_curve_power and the ready to use default_curve
+ * spline are generated from CONFIG_BRIGHTNESS_DEFAULT_CURVE, all const. */
+
+/* Default lux filter chain, see abc_set_lux_filter() to replace it. */
+static const struct lightsensor_filter_config_s g_lux_filter[] = {
+#if CONFIG_LIGHTSENSOR_MEDIAN_WINDOW > 1
+    {
+        .type = LIGHTSENSOR_FILTER_MEDIAN,
+        .median = {CONFIG_LIGHTSENSOR_MEDIAN_WINDOW},
+    },
+#endif
+#if CONFIG_LIGHTSENSOR_OUTLIER_THRESHOLD > 0
+    {
+        .type = LIGHTSENSOR_FILTER_OUTLIER,
+        .outlier =
+            {
+                REAL(CONFIG_LIGHTSENSOR_OUTLIER_THRESHOLD / 100.0f),
+                LIGHTSENSOR_OUTLIER_TIME,
+            },
+    },
+#endif
+    {
+        .type = LIGHTSENSOR_FILTER_HYSTERESIS,
+        .hysteresis =
+            {
+                CONFIG_LIGHTSENSOR_SMOOTHING_TIME,
+                REAL(LIGHTSENSOR_JITTER_THRESHOLD),
+                REAL(CONFIG_LIGHTSENSOR_BRIGHTEN_THRESHOLD / 100.0f),
+                REAL(CONFIG_LIGHTSENSOR_DARKEN_THRESHOLD / 100.0f),
+                CONFIG_LIGHTSENSOR_BRIGHTEN_TIME,
+                CONFIG_LIGHTSENSOR_DARKEN_TIME,
+                REAL(CONFIG_LIGHTSENSOR_FAST_THRESHOLD / 100.0f),
+                CONFIG_LIGHTSENSOR_FAST_TIME,
+            },
+    },
 };
 
-static const float default_curve_power[] = {
-    1,  5,  10, 20, 30, 46,  49,  54,  61,  65,
-    70, 76, 82, 87, 98, 108, 131, 161, 230, 255,
+static const struct abc_response_s g_response_default = {
+    CONFIG_LIGHTSENSOR_BRIGHTEN_TIME,
+    CONFIG_LIGHTSENSOR_DARKEN_TIME,
+    CONFIG_LIGHTSENSOR_BRIGHTEN_THRESHOLD,
+    CONFIG_LIGHTSENSOR_DARKEN_THRESHOLD,
 };
 
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
-static void lightsensor_update_cb(const struct sensor_light data[], int n,
-                                  void *user_data)
+/* Update the hysteresis stages of the filter chain with abc->response. */
+static void apply_response(struct abc_s *abc)
 {
-    struct abc_s *abc = user_data;
-    if (n < 1) {
-        err("No valid data\n");
-        return;
+    struct lightsensor_filter_config_s *config;
+
+    for (int i = 0; i < abc->filter.nstages; i++) {
+        config = &abc->filter.stages[i].config;
+        if (config->type != LIGHTSENSOR_FILTER_HYSTERESIS) {
+            continue;
+        }
+
+        config->hysteresis.brighten_time = abc->response.brighten_time;
+        config->hysteresis.darken_time = abc->response.darken_time;
+        config->hysteresis.brighten =
+            REAL_RATIO(abc->response.brighten_threshold, 100);
+        config->hysteresis.darken =
+            REAL_RATIO(abc->response.darken_threshold, 100);
+    }
+}
+
+/**
+ * Track how long lux stays flat, as the sensor can sample slower then.
+ * @param timestamp Sample timestamp in us
+ * @param lux Raw sample
+ * @return Sample rate in Hz for the lux seen so far.
+ */
+static unsigned int sample_rate(struct abc_s *abc, uint64_t timestamp,
+                                real_t lux)
+{
+    real_t jitter =
+        REAL_MUL(abc->idle_lux, REAL(LIGHTSENSOR_JITTER_THRESHOLD)) +
+        REAL_ITOR(LIGHTSENSOR_IDLE_NOISE);
+
+    if (abc->idle_since == 0 || timestamp < abc->idle_since ||
+        REAL_ABS(lux - abc->idle_lux) > jitter) {
+        abc->idle_lux = lux;
+        abc->idle_since = timestamp;
+    } else if (timestamp - abc->idle_since >=
+               CONFIG_LIGHTSENSOR_IDLE_TIME * 1000ull) {
+        return CONFIG_LIGHTSENSOR_IDLE_FREQUENCY;
     }
 
-    float lux = data[0].light;
-    abc->lux_last = lux;
+    return CONFIG_LIGHTSENSOR_FREQUENCY;
+}
+
+static int lux_to_brightness(struct abc_s *abc, real_t lux)
+{
+    real_t power = REAL_INTERPOLATE(abc->spline, lux);
+    info("lux: %.2f, power: %.2f\n", REAL_TOF(lux), REAL_TOF(power));
+    int brightness = REAL_TOI(power);
+
+    /* Limit the brightness value */
+    if (brightness > BACKLIGHT_LEVEL_MAX) {
+        brightness = BACKLIGHT_LEVEL_MAX;
+    } else if (brightness < BACKLIGHT_LEVEL_MIN) {
+        brightness = BACKLIGHT_LEVEL_MIN;
+    }
+
+    return brightness;
+}
+
+/**
+ * Run one sample through the filter.
+ * @param timestamp Sample timestamp in us
+ * @param lux Sample, replaced by the filtered lux
+ * @return True if the filtered lux is steady and should set brightness.
+ */
+static bool lightsensor_sample(struct abc_s *abc, uint64_t timestamp,
+                               real_t *lux)
+{
+    abc->lux_last = *lux;
 
     if (!abc->running) {
         /* If abc is not running due to short-term model, resume it after
          * dramatic change. */
-        if (abc->interactive_model == NULL) {
+        if (!abc->interactive.active) {
             /* interactive model timeout already */
-            if (fabsf(lux - abc->user_lux) >
-                abc->user_lux * LIGHTSENSOR_DRAMATIC_THRESHOLD) {
+            real_t user_lux = REAL_ITOR(abc->user_lux);
+            int threshold = *lux > user_lux ? abc->response.brighten_threshold
+                                            : abc->response.darken_threshold;
+            if (REAL_ABS(*lux - user_lux) >
+                REAL_MUL(user_lux, REAL_RATIO(threshold, 100))) {
                 abc->running = true;
             }
         }
+        return false;
+    }
+
+    return lightsensor_filter_update(&abc->filter, timestamp, lux);
+}
+
+static void lightsensor_update_cb(const struct sensor_light data[], int n,
+                                  void *user_data)
+{
+    struct abc_s *abc = user_data;
+    bool update = false;
+    bool fast = false;
+    real_t lux_set = 0;
+    real_t lux;
+    unsigned int rate = 0;
+    int step = 1;
+    int i = 0;
+
+    if (n < 1) {
+        err("No valid data\n");
         return;
     }
 
-    /* Check if input is steady. */
-    if (fabsf(lux - abc->lux_set) > abc->lux_set * LIGHTSENSOR_DRAMATIC_THRESHOLD) {
-        abc->steady_count = 0;
-        abc->lux_filtered = lux;
-        abc->dramatic_count++;
-        if (abc->dramatic_count < LIGHTSENSOR_STEADY_COUNT) {
-            /* Not dramatic enough */
-            return;
-        }
-    } else {
-        abc->dramatic_count = 0;
-        abc->lux_filtered = lux * LIGHTSENSOR_FILTER_FACTOR +
-                            abc->lux_filtered * (1 - LIGHTSENSOR_FILTER_FACTOR);
-        if (fabsf(lux - abc->lux_filtered) >
-            abc->lux_filtered * LIGHTSENSOR_JITTER_THRESHOLD) {
-            /* Ignore non-stable results */
-            abc->steady_count = 0;
-            return;
-        }
+    /* Batches are oldest first, take them in reverse if they are not. */
+    if (data[0].timestamp > data[n - 1].timestamp) {
+        i = n - 1;
+        step = -1;
+    }
 
-        abc->steady_count++;
-        if (abc->steady_count < LIGHTSENSOR_STEADY_COUNT) {
-            /* Not stable enough. */
-            return;
+    for (; i >= 0 && i < n; i += step) {
+        lux = REAL_LUX(data[i].light);
+        rate = sample_rate(abc, data[i].timestamp, lux);
+
+        /* The first sample taken after a pause decides brightness, the
+         * ones the sensor held from before it are skipped. */
+        if (abc->reacquire && data[i].timestamp > abc->filter.timestamp) {
+            abc->reacquire = false;
+            abc->lux_last = lux;
+            lightsensor_filter_seed(&abc->filter, data[i].timestamp, lux);
+            lux_set = lux;
+            fast = true;
+            update = true;
+        } else if (lightsensor_sample(abc, data[i].timestamp, &lux)) {
+            lux_set = lux;
+            fast = abc->filter.fast;
+            update = true;
         }
-
-        /* Clear for next detection. */
-        abc->steady_count = 0;
     }
 
-    lux = abc->lux_filtered;
-    abc->lux_set = lux;
-    float power = spline_interpolate(abc->spline, lux);
-    info("lux: %.2f, power: %.2f\n", lux, power);
-    int brightness = (int)power;
+    /* Slow down while lux is flat, speed up as soon as it moves. */
+    if (CONFIG_LIGHTSENSOR_IDLE_FREQUENCY > 0 &&
+        rate != lightsensor_get_frequency(abc->sensor) &&
+        lightsensor_set_frequency(abc->sensor, rate) == OK) {
+        lightsensor_filter_set_frequency(&abc->filter, rate);
+    }
 
-    /* Limit the brightness value */
-    if (brightness > BACKLIGHT_LEVEL_MAX) {
-        brightness = BACKLIGHT_LEVEL_MAX;
-    } else if (brightness < BACKLIGHT_LEVEL_MIN) {
-        brightness = BACKLIGHT_LEVEL_MIN;
+    /* Only the latest steady lux of the batch sets brightness. */
+    if (!update) {
+        return;
     }
 
+    int brightness = lux_to_brightness(abc, lux_set);
     if (brightness != abc->target) {
         abc->target = brightness;
         display_brightness_set(abc->display, brightness,
-                               BRIGHTNESS_RAMP_SPEED_DEFAULT);
+                               fast ? CONFIG_LIGHTSENSOR_FAST_RAMP
+                                    : BRIGHTNESS_RAMP_SPEED_DEFAULT,
+                               AUTO_RAMP_CURVE);
     }
 }
 
-static float calculate_adjustment(float max_gamma, float desired, float current)
+static real_t calculate_adjustment(real_t max_gamma, real_t desired,
+                                   real_t current)
 {
-    float adjustment = 0;
-    if (current <= 0.1f || current >= 0.9f) {
+    real_t adjustment = 0;
+    if (current <= REAL(0.1f) || current >= REAL(0.9f)) {
         adjustment = desired - current;
     } else if (desired == 0) {
-        adjustment = -1.f;
-    } else if (desired == 1) {
-        adjustment = +1.f;
+        adjustment = REAL(-1.f);
+    } else if (desired == REAL(1)) {
+        adjustment = REAL(+1.f);
     } else {
-        float gamma = logf(desired) / logf(current);
+        real_t gamma = REAL_DIV(REAL_LOG2(desired), REAL_LOG2(current));
         /* max^-adjustment = gamma --> adjustmen = -log[max]gamma */
-        adjustment = -logf(gamma) / logf(max_gamma);
+        adjustment = -REAL_DIV(REAL_LOG2(gamma), REAL_LOG2(max_gamma));
     }
 
-    if (adjustment > 1) {
-        adjustment = 1;
-    } else if (adjustment < -1) {
-        adjustment = -1;
+    if (adjustment > REAL(1)) {
+        adjustment = REAL(1);
+    } else if (adjustment < REAL(-1)) {
+        adjustment = REAL(-1);
     }
 
     return adjustment;
 }
 
-static void compute_spline(struct abc_s *abc, float user_lux,
-                           int user_brightness, float max_gamma)
+/**
+ * Add a user point. Older points it contradicts, brighter at lower lux or
+ * darker at higher lux, go, and so does one at close lux. Without room the
+ * oldest point goes.
+ */
+static void add_user_point(struct abc_s *abc, int lux, int brightness)
 {
-    void *old;
-    float current_brightness;
-    float pre_brightness;
-    float gamma;
+    struct user_point_s *points = abc->user_points;
+    struct user_point_s *p;
+    int oldest = 0;
+    int n = 0;
     int i;
-    int j;
-
-    float current = spline_interpolate(abc->spline, user_lux) / 255.0f;
-    float desired = user_brightness / 255.0f;
-    float adjustment = calculate_adjustment(MAX_GAMMA, desired, current);
 
-    /**
-     * Adjust curve with new adjustment
-     */
-    int points = abc->npoints + (user_lux > 0 ? 1 : 0);
-    float *new_lux = malloc(points * sizeof(float));
-    DEBUGASSERT(new_lux != NULL);
-    float *new_brightness = malloc(points * sizeof(float));
-    DEBUGASSERT(new_brightness != NULL);
+    for (i = 0; i < abc->nuser_points; i++) {
+        p = &points[i];
+        if ((p->lux < lux && p->brightness > brightness) ||
+            (p->lux > lux && p->brightness < brightness) ||
+            (MAX(p->lux, lux) < MIN(p->lux, lux) * USER_POINT_MERGE_RATIO)) {
+            info("forget user point: %d, %d\n", p->lux, p->brightness);
+            continue;
+        }
 
-    /**
-     * Copy default table
-     */
-    memcpy(new_lux, abc->default_curve_lux, abc->npoints * sizeof(float));
-    memcpy(new_brightness, abc->default_curve_power,
-           abc->npoints * sizeof(float));
+        points[n++] = *p;
+    }
 
-    /**
-     * Apply adjustment for all points
-     */
-    gamma = powf(max_gamma, -adjustment);
-    if (gamma != 1) {
-        for (i = 0; i < abc->npoints; i++) {
-            new_brightness[i] =
-                powf(new_brightness[i] / 255.0f, gamma) * 255.0f;
+    if (n == USER_POINTS_MAX) {
+        for (i = 1; i < n; i++) {
+            if (points[i].seq < points[oldest].seq) {
+                oldest = i;
+            }
         }
+
+        info("age out user point: %d, %d\n", points[oldest].lux,
+             points[oldest].brightness);
+        memmove(&points[oldest], &points[oldest + 1],
+                (n - oldest - 1) * sizeof(*points));
+        n--;
     }
 
-    info("adjustment: %.3f, gamma: %.3f\n", adjustment, gamma);
-    info("user_lux: %.3f, user_brightness: %d\n", user_lux, user_brightness);
+    for (i = n; i > 0 && points[i - 1].lux > lux; i--) {
+        points[i] = points[i - 1];
+    }
 
-    /* Insert user point */
-    if (user_lux > 0) {
-        /* Find insert position. */
-        i = 0;
-        while (i < abc->npoints && new_lux[i] < user_lux) {
-            i++;
+    points[i].lux = lux;
+    points[i].brightness = brightness;
+    points[i].seq = ++abc->user_seq;
+    abc->nuser_points = n + 1;
+}
+
+static bool is_user_point(const struct curve_job_s *job, float lux,
+                          float brightness)
+{
+    for (int i = 0; i < job->npoints; i++) {
+        if (job->points[i].lux == lux &&
+            job->points[i].brightness == brightness) {
+            return true;
         }
+    }
 
-        if (i < abc->npoints) {
-            /* Move away the remaining points */
-            memmove(new_lux + i + 1, new_lux + i,
-                    (abc->npoints - i) * sizeof(float));
-            memmove(new_brightness + i + 1, new_brightness + i,
-                    (abc->npoints - i) * sizeof(float));
+    return false;
+}
+
+static bool is_default_lux(struct abc_s *abc, float lux)
+{
+    for (int i = 0; i < abc->npoints; i++) {
+        if (abc->default_curve_lux[i] == lux) {
+            return true;
         }
+    }
 
-        /* Insert it here */
-        new_lux[i] = user_lux;
-        new_brightness[i] = user_brightness;
+    return false;
+}
 
-        /* smooth out the curve */
-        pre_brightness = new_brightness[i];
+/**
+ * Brightness of default point 'i' once user points are applied. A user
+ * point at the same lux replaces it, otherwise it is flattened to the user
+ * points around it to keep the curve monotonic.
+ */
+static float default_point_target(struct abc_s *abc,
+                                  const struct curve_job_s *job, int i)
+{
+    const struct user_point_s *p;
+    float lux = abc->default_curve_lux[i];
+    float target = abc->gamma_power[i];
+    int k;
+
+    /* Points are by lux, so all the ones below come first. */
+    for (k = 0; k < job->npoints; k++) {
+        p = &job->points[k];
+        if (p->lux == lux) {
+            return p->brightness;
+        } else if (p->lux < lux) {
+            target = MAX(target, p->brightness);
+        } else {
+            target = MIN(target, p->brightness);
+        }
+    }
 
-        /* Smooth out data above */
-        for (j = i + 1; j < abc->npoints; j++) {
-            current_brightness = new_brightness[j];
+    return target;
+}
 
-            if (current_brightness >= pre_brightness) {
-                break;
-            }
+/* Build the whole curve in 'storage'. */
+static int build_curve(struct abc_s *abc, struct curve_job_s *job,
+                       void *storage)
+{
+    const struct user_point_s *p = job->points;
+    const struct user_point_s *end = p + job->npoints;
+    float *new_lux = abc->curve_lux;
+    float *new_brightness = abc->curve_power;
+    int points = 0;
+    int i;
 
-            new_brightness[j] = pre_brightness;
+    for (i = 0; i < abc->npoints; i++) {
+        /* Insert user points below this default point */
+        for (; p < end && p->lux < abc->default_curve_lux[i]; p++) {
+            new_lux[points] = p->lux;
+            new_brightness[points] = p->brightness;
+            points++;
         }
 
-        /* Smooth data below */
-        for (j = i - 1; j >= 0; j--) {
-            current_brightness = new_brightness[j];
+        if (p < end && p->lux == abc->default_curve_lux[i]) {
+            p++;
+        }
 
-            if (current_brightness <= pre_brightness) {
-                break;
-            }
+        new_lux[points] = abc->default_curve_lux[i];
+        new_brightness[points] = default_point_target(abc, job, i);
+        points++;
+    }
 
-            new_brightness[j] = pre_brightness;
-        }
+    for (; p < end; p++) {
+        new_lux[points] = p->lux;
+        new_brightness[points] = p->brightness;
+        points++;
     }
 
 #ifdef CONFIG_BRIGHTNESS_SERVICE_DEBUG_INFO
@@ -312,93 +572,388 @@ static void compute_spline(struct abc_s *abc, float user_lux,
 #endif
 
     /* Update spline */
-    old = abc->spline;
-    abc->spline = spline_create(new_lux, new_brightness, points);
-    if (abc->spline == NULL) {
+    job->spline = spline_init_storage(storage, abc->curve_size, new_lux,
+                                      new_brightness, points,
+                                      abc->npoints + USER_POINTS_MAX);
+    if (job->spline == NULL) {
+        return ERROR;
+    }
+
+    job->curve_points = points;
+    return OK;
+}
+
+/**
+ * Move a copy of the curve to the user points when gamma is unchanged.
+ * Only points that differ are touched, in an order that keeps the curve
+ * monotonic.
+ */
+static int update_curve(struct abc_s *abc, struct curve_job_s *job,
+                        struct spline_s *spline)
+{
+    const struct user_point_s *p;
+    float target;
+    float x;
+    float y;
+    int i;
+    int j;
+
+    /* Take out user points that are gone, the rest fit the new curve. */
+    for (j = 0; j < job->curve_points;) {
+        spline_get_point(spline, j, &x, &y);
+        if (is_default_lux(abc, x) || is_user_point(job, x, y)) {
+            j++;
+        } else if (spline_remove_point(spline, j) < 0) {
+            return ERROR;
+        } else {
+            job->curve_points--;
+        }
+    }
+
+    /* Raise points from right to left, then lower them from left to right */
+    j = job->curve_points - 1;
+    for (i = abc->npoints - 1; i >= 0; i--) {
+        while (spline_get_point(spline, j, &x, &y) == OK &&
+               x != abc->default_curve_lux[i]) {
+            j--;
+        }
+
+        target = default_point_target(abc, job, i);
+        if (target > y && spline_move_point(spline, j, x, target) < 0) {
+            return ERROR;
+        }
+    }
+
+    j = 0;
+    for (i = 0; i < abc->npoints; i++) {
+        while (spline_get_point(spline, j, &x, &y) == OK &&
+               x != abc->default_curve_lux[i]) {
+            j++;
+        }
+
+        target = default_point_target(abc, job, i);
+        if (target < y && spline_move_point(spline, j, x, target) < 0) {
+            return ERROR;
+        }
+    }
+
+    /* Add new user points, the ones in place are left as they are. */
+    for (i = 0; i < job->npoints; i++) {
+        p = &job->points[i];
+        if (is_default_lux(abc, p->lux)) {
+            continue;
+        }
+
+        if (spline_insert_point(spline, p->lux, p->brightness) < 0) {
+            return ERROR;
+        }
+    }
+
+    job->curve_points = abc->npoints;
+    for (i = 0; i < job->npoints; i++) {
+        job->curve_points += !is_default_lux(abc, job->points[i].lux);
+    }
+
+    job->spline = spline;
+    return OK;
+}
+
+static int alloc_curve(struct abc_s *abc)
+{
+    if (abc->curve[0]) {
+        return OK;
+    }
+
+    abc->curve_size = spline_storage_size(
+        abc->default_curve_lux, abc->npoints, abc->npoints + USER_POINTS_MAX);
+    abc->curve[0] = malloc(abc->curve_size);
+    abc->curve[1] = malloc(abc->curve_size);
+    abc->gamma_power =
+        malloc((3 * abc->npoints + 2 * USER_POINTS_MAX) * sizeof(float));
+    if (abc->curve[0] == NULL || abc->curve[1] == NULL ||
+        abc->gamma_power == NULL) {
+        err("No memory for curve\n");
+        free(abc->curve[0]);
+        free(abc->curve[1]);
+        free(abc->gamma_power);
+        abc->curve[0] = NULL;
+        abc->curve[1] = NULL;
+        abc->gamma_power = NULL;
+        return ERROR;
+    }
+
+    abc->curve_lux = abc->gamma_power + abc->npoints;
+    abc->curve_power = abc->curve_lux + abc->npoints + USER_POINTS_MAX;
+    abc->job.power_gamma = REAL(-1);
+    return OK;
+}
+
+/* Runs on the worker, the current curve is only read. */
+static int run_curve_job(struct abc_s *abc)
+{
+    struct curve_job_s *job = &abc->job;
+    void *storage = abc->curve[abc->curve_spare];
+    struct spline_s *spline;
+    real_t power;
+    int i;
+
+    /**
+     * Gamma is unchanged, the adjusted default curve is copied and only
+     * the points around user points are updated.
+     */
+    if (abc->spline == abc->curve[!abc->curve_spare] &&
+        job->gamma == abc->gamma && job->gamma == job->power_gamma) {
+        spline = spline_copy(storage, abc->curve_size, abc->spline);
+        job->curve_points = abc->curve_points;
+        if (spline != NULL && update_curve(abc, job, spline) == OK) {
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+            job->updates++;
+#endif
+            return OK;
+        }
+    }
+
+    /**
+     * Apply adjustment for all points
+     */
+    for (i = 0; i < abc->npoints; i++) {
+        abc->gamma_power[i] = abc->default_curve_power[i];
+        if (job->gamma != REAL(1)) {
+            power = REAL_FTOR(abc->gamma_power[i]);
+            power = REAL_POW(REAL_DIV(power, REAL(255.0f)), job->gamma);
+            abc->gamma_power[i] = REAL_TOF(REAL_MUL(power, REAL(255.0f)));
+        }
+    }
+
+    job->power_gamma = job->gamma;
+    return build_curve(abc, job, storage);
+}
+
+/* Back on the loop, switch to the new curve. */
+static void finish_curve_job(struct abc_s *abc, int status)
+{
+    struct curve_job_s *job = &abc->job;
+
+    job->busy = false;
+    if (abc->closing) {
+        release_abc(abc);
+        return;
+    }
+
+    if (status < 0 || job->status < 0) {
+        /* Only the spare buffer is written, the current curve stays. */
         err("Failed to create spline\n");
-        abc->spline = old;
     } else {
-        spline_destroy(old);
+        abc->spline = job->spline;
+        abc->curve_spare = !abc->curve_spare;
+        abc->gamma = job->gamma;
+        abc->curve_points = job->curve_points;
+    }
+
+    /* The next adjustment is measured against the curve just built. */
+    if (abc->nadjust > 0) {
+        struct user_point_s next = abc->adjust[0];
+
+        abc->nadjust--;
+        memmove(&abc->adjust[0], &abc->adjust[1],
+                abc->nadjust * sizeof(*abc->adjust));
+        job->pending = false;
+        learn_user_point(abc, next.lux, next.brightness);
+    } else if (job->pending) {
+        job->pending = false;
+        queue_curve(abc);
+    }
+}
+
+static void curve_work_cb(uv_work_t *req)
+{
+    struct abc_s *abc = req->data;
+
+    abc->job.status = run_curve_job(abc);
+}
+
+static void curve_after_work_cb(uv_work_t *req, int status)
+{
+    finish_curve_job(req->data, status);
+}
+
+static void prepare_curve_job(struct abc_s *abc)
+{
+    struct curve_job_s *job = &abc->job;
+
+    memcpy(job->points, abc->user_points,
+           abc->nuser_points * sizeof(*job->points));
+    job->npoints = abc->nuser_points;
+    job->gamma = abc->user_gamma;
+    job->busy = true;
+}
+
+/**
+ * Build the curve of the current user points on the work queue, so ramps
+ * on the loop are not held up. Changes made meanwhile are picked up by
+ * another build once it is done.
+ */
+static void queue_curve(struct abc_s *abc)
+{
+    struct curve_job_s *job = &abc->job;
+    int ret;
+
+    if (alloc_curve(abc) < 0) {
+        return;
+    }
+
+    if (job->busy) {
+        job->pending = true;
+        return;
+    }
+
+    prepare_curve_job(abc);
+    job->work.data = abc;
+    ret = uv_queue_work(abc->loop, &job->work, curve_work_cb,
+                        curve_after_work_cb);
+    if (ret < 0) {
+        warn("No worker for curve: %d\n", ret);
+        job->status = run_curve_job(abc);
+        finish_curve_job(abc, OK);
+    }
+}
+
+/**
+ * Learn a user adjustment, the curve follows once queue_curve() is done.
+ * The first adjustment of a session sets gamma. The ones that follow it
+ * within ADJUST_SESSION_TIMEOUT keep that gamma and only move user points,
+ * so the curve is edited instead of rebuilt.
+ */
+static void compute_spline(struct abc_s *abc, int user_lux,
+                           int user_brightness, real_t max_gamma)
+{
+    uint64_t now = uv_now(abc->loop);
+    real_t adjustment;
+    real_t current;
+    real_t desired;
+
+    if (now >= abc->session_end) {
+        current = REAL_DIV(REAL_INTERPOLATE(abc->spline, REAL_ITOR(user_lux)),
+                           REAL(255.0f));
+        desired = REAL_DIV(REAL_ITOR(user_brightness), REAL(255.0f));
+        adjustment = calculate_adjustment(REAL(MAX_GAMMA), desired, current);
+        abc->user_gamma = REAL_POW(max_gamma, -adjustment);
+
+        info("adjustment: %.3f, gamma: %.3f\n", REAL_TOF(adjustment),
+             REAL_TOF(abc->user_gamma));
+    }
+
+    abc->session_end = now + ADJUST_SESSION_TIMEOUT;
+    info("user_lux: %d, user_brightness: %d\n", user_lux, user_brightness);
+
+    if (user_lux > 0) {
+        add_user_point(abc, user_lux, user_brightness);
+    }
+}
+
+/* Free once the last callback deinit waits for is done. */
+static void release_abc(struct abc_s *abc)
+{
+    if (--abc->closing > 0) {
+        return;
     }
 
-    free(new_lux);
-    free(new_brightness);
+    free(abc->curve[0]);
+    free(abc->curve[1]);
+    free(abc->gamma_power);
+    free(abc);
+}
+
+static void interactive_close_cb(uv_handle_t *handle)
+{
+    release_abc(handle->data);
 }
 
-static void interactive_timer_close_cb(uv_handle_t *handle)
+/* Adjust the curve and save the user points. */
+static void learn_user_point(struct abc_s *abc, int lux, int target)
 {
-    if (handle->data) {
-        free(handle->data);
+    compute_spline(abc, lux, target, REAL(MAX_GAMMA));
+    queue_curve(abc);
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_PERSISTENT
+    int points_lux[USER_POINTS_MAX];
+    int points_target[USER_POINTS_MAX];
+    int n;
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+    if (abc->nosave) {
+        return;
     }
+#endif
+
+    n = abc_get_user_points(abc, points_lux, points_target, USER_POINTS_MAX);
+    brightness_save_user_points(points_lux, points_target, n,
+                                abc_get_user_gamma(abc));
+#endif
 }
 
 static void update_user_point(struct abc_s *abc, int lux, int target)
 {
-    compute_spline(abc, lux, target, MAX_GAMMA);
+    struct user_point_s *p;
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    lux = MIN(lux, REAL_LUX_MAX);
+#endif
 
     /* Add set user point */
     abc->user_brightness = target;
     abc->user_lux = lux;
 
-#ifdef CONFIG_BRIGHTNESS_SERVICE_PERSISTENT
-    brightness_save_user_point(lux, target);
-#endif
+    if (!abc->job.busy) {
+        learn_user_point(abc, lux, target);
+        return;
+    }
+
+    /* Without room the oldest waiting one goes by the current curve. */
+    if (abc->nadjust == USER_POINTS_MAX) {
+        p = &abc->adjust[0];
+        abc->nadjust--;
+        compute_spline(abc, p->lux, p->brightness, REAL(MAX_GAMMA));
+        memmove(&abc->adjust[0], &abc->adjust[1],
+                abc->nadjust * sizeof(*abc->adjust));
+    }
+
+    p = &abc->adjust[abc->nadjust++];
+    p->lux = lux;
+    p->brightness = target;
 }
 
 static void abc_interactive_timeout(uv_timer_t *handle)
 {
     struct abc_s *abc = handle->data;
-    struct short_term_model_s *model = abc->interactive_model;
+    struct short_term_model_s *model = &abc->interactive;
 
     info("\n");
 
-    if (model == NULL) {
-        err("No interactive model\n");
-        uv_timer_stop(handle);
-        uv_close((uv_handle_t *)handle, NULL);
-        return;
-    }
-
-    update_user_point(abc, model->lux, model->brightness);
+    /* The short term model ends, before the point goes to the curve */
+    model->active = false;
+    update_user_point(abc, REAL_TOI(model->lux), model->brightness);
 
     /* Resume auto brightness */
     abc->running = true;
-
-    /* Destroy the short term model */
-    stop_interactive_model(abc);
 }
 
 static void start_interactive_model(struct abc_s *abc, int target)
 {
-    struct short_term_model_s *model = abc->interactive_model;
-
-    if (model) {
-        uv_timer_stop(&model->timer);
-    } else {
-        model = calloc(sizeof(*model), 1);
-        DEBUGASSERT(model != NULL);
-        abc->interactive_model = model;
-        uv_timer_init(abc->loop, &model->timer);
-    }
+    struct short_term_model_s *model = &abc->interactive;
 
+    /* A running timer starts over. */
+    model->active = true;
     model->brightness = target;
     model->lux = abc->lux_last;
-    model->timer.data = abc;
     uv_timer_start(&model->timer, abc_interactive_timeout,
                    INTERACTIVE_SHORT_TERM_MODEL_TIMEOUT, 0);
 }
 
 static void stop_interactive_model(struct abc_s *abc)
 {
-    struct short_term_model_s *model = abc->interactive_model;
-
-    if (model) {
-        abc->interactive_model = NULL;
-
-        model->timer.data = model; /* Deferered to delete model data. */
-        uv_timer_stop(&model->timer);
-        uv_close((uv_handle_t *)&model->timer, interactive_timer_close_cb);
-    }
+    abc->interactive.active = false;
+    uv_timer_stop(&abc->interactive.timer);
 }
 
 /****************************************************************************
@@ -430,10 +985,15 @@ struct abc_s *abc_init(uv_loop_t *loop, struct display_brightness_s *display)
     abc->default_curve_lux = default_curve_lux;
     abc->default_curve_power = default_curve_power;
     abc->npoints = nitems(default_curve_lux);
-    abc->spline = spline_create(default_curve_lux, default_curve_power,
-                                nitems(default_curve_lux));
+    abc->spline = (struct spline_s *)&default_curve; /* Read-only */
+    abc->gamma = REAL(1);
+    abc->user_gamma = REAL(1);
     abc->user_lux = default_curve_lux[0];
     abc->user_brightness = default_curve_power[0];
+    abc->response = g_response_default;
+    lightsensor_filter_init(&abc->filter, g_lux_filter, nitems(g_lux_filter));
+    uv_timer_init(loop, &abc->interactive.timer);
+    abc->interactive.timer.data = abc;
 
     info("start abc: %p\n", abc);
     return abc;
@@ -442,9 +1002,7 @@ struct abc_s *abc_init(uv_loop_t *loop, struct display_brightness_s *display)
 int abc_set_user_point(struct abc_s *abc, int lux, int target)
 {
     /* User is manually adjusting */
-    if (abc->interactive_model) {
-        stop_interactive_model(abc);
-    }
+    stop_interactive_model(abc);
 
     update_user_point(abc, lux, target);
     return OK;
@@ -463,6 +1021,198 @@ int abc_get_user_point(struct abc_s *abc, int *lux, int *target)
     return OK;
 }
 
+int abc_get_user_points(struct abc_s *abc, int lux[], int target[], int n)
+{
+    const struct user_point_s *p;
+    int skip = MAX(abc->nuser_points - n, 0);
+    uint32_t seq = 0;
+    int next;
+    int i;
+    int k;
+
+    /* Few points, pick the next oldest each time. */
+    for (k = 0; k < abc->nuser_points; k++) {
+        next = -1;
+        for (i = 0; i < abc->nuser_points; i++) {
+            p = &abc->user_points[i];
+            if (p->seq > seq &&
+                (next < 0 || p->seq < abc->user_points[next].seq)) {
+                next = i;
+            }
+        }
+
+        p = &abc->user_points[next];
+        seq = p->seq;
+        if (k >= skip) {
+            lux[k - skip] = p->lux;
+            target[k - skip] = p->brightness;
+        }
+    }
+
+    return abc->nuser_points - skip;
+}
+
+int abc_set_user_points(struct abc_s *abc, const int lux[], const int target[],
+                        int n, int gamma)
+{
+    int i;
+
+    /* Adjustments are within MAX_GAMMA either way. */
+    if (n < 0 || gamma < (int)(BRIGHTNESS_USER_GAMMA_ONE / MAX_GAMMA) ||
+        gamma > (int)(BRIGHTNESS_USER_GAMMA_ONE * MAX_GAMMA)) {
+        return -EINVAL;
+    }
+
+    info("set %d user points, gamma: %d\n", n, gamma);
+
+    /* Saved points agree with each other, they are taken as they are. */
+    abc->nuser_points = 0;
+    abc->nadjust = 0;
+    for (i = 0; i < n; i++) {
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+        int point_lux = MIN(lux[i], REAL_LUX_MAX);
+#else
+        int point_lux = lux[i];
+#endif
+
+        if (point_lux > 0) {
+            add_user_point(abc, point_lux, target[i]);
+            abc->user_lux = point_lux;
+            abc->user_brightness = target[i];
+        }
+    }
+
+    /* The next adjustment sets gamma again. */
+    abc->user_gamma = REAL_RATIO(gamma, BRIGHTNESS_USER_GAMMA_ONE);
+    abc->session_end = 0;
+    queue_curve(abc);
+    return OK;
+}
+
+int abc_get_user_gamma(struct abc_s *abc)
+{
+    return REAL_TOI(REAL_MUL(abc->user_gamma,
+                             REAL_ITOR(BRIGHTNESS_USER_GAMMA_ONE)) +
+                    REAL(0.5f));
+}
+
+int abc_set_lux_filter(struct abc_s *abc,
+                       const struct lightsensor_filter_config_s stages[],
+                       int n)
+{
+    int ret;
+
+    if (n == 0) {
+        stages = g_lux_filter;
+        n = nitems(g_lux_filter);
+    }
+
+    ret = lightsensor_filter_init(&abc->filter, stages, n);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Hysteresis stages follow abc_set_response(), not their config. */
+    apply_response(abc);
+
+    /* The filter starts at CONFIG_LIGHTSENSOR_FREQUENCY, keep the rate. */
+    lightsensor_filter_set_frequency(&abc->filter,
+                                     lightsensor_get_frequency(abc->sensor));
+    return OK;
+}
+
+int abc_set_response(struct abc_s *abc,
+                     const struct abc_response_s *response)
+{
+    if (response == NULL) {
+        response = &g_response_default;
+    }
+
+    if (response->brighten_time < 0 || response->darken_time < 0 ||
+        response->brighten_time > RESPONSE_TIME_MAX ||
+        response->darken_time > RESPONSE_TIME_MAX ||
+        response->brighten_threshold < 0 || response->darken_threshold < 0 ||
+        response->darken_threshold > 100) {
+        err("invalid response: %d ms %d%%, %d ms %d%%\n",
+            response->brighten_time, response->brighten_threshold,
+            response->darken_time, response->darken_threshold);
+        return -EINVAL;
+    }
+
+    info("brighten: %d ms %d%%, darken: %d ms %d%%\n",
+         response->brighten_time, response->brighten_threshold,
+         response->darken_time, response->darken_threshold);
+
+    abc->response = *response;
+    apply_response(abc);
+    return OK;
+}
+
+int abc_get_response(struct abc_s *abc, struct abc_response_s *response)
+{
+    *response = abc->response;
+    return OK;
+}
+
+int abc_pause(struct abc_s *abc, int reason)
+{
+    int paused = abc->paused;
+
+    abc->paused |= reason;
+    if (paused == 0 && abc->paused != 0) {
+        info("pause abc: %#x\n", abc->paused);
+        lightsensor_pause(abc->sensor);
+    }
+
+    return OK;
+}
+
+int abc_resume(struct abc_s *abc, int reason)
+{
+    int current = 0;
+    int level;
+
+    if ((abc->paused & reason) == 0) {
+        return OK;
+    }
+
+    abc->paused &= ~reason;
+    if (abc->paused != 0) {
+        return OK;
+    }
+
+    info("resume abc\n");
+
+    /* Come back at the last brightness, and at full rate so the first
+     * new sample corrects it quickly. Jump there if the panel is off. */
+    level = abc->target >= 0 ? abc->target
+                             : lux_to_brightness(abc, abc->lux_last);
+    abc->target = level;
+    abc->running = true;
+    abc->reacquire = true;
+    abc->idle_since = 0;
+    if (display_brightness_get(abc->display, &current) < 0) {
+        /* Unknown level, do not ramp from it. */
+        warn("failed to read brightness, set it at once\n");
+        current = 0;
+    }
+
+    display_brightness_set(abc->display, level,
+                           current == 0 ? BRIGHTNESS_RAMP_SPEED_OFF
+                                        : BRIGHTNESS_RAMP_SPEED_DEFAULT,
+                           AUTO_RAMP_CURVE);
+
+    lightsensor_set_frequency(abc->sensor, CONFIG_LIGHTSENSOR_FREQUENCY);
+    lightsensor_filter_set_frequency(&abc->filter,
+                                     lightsensor_get_frequency(abc->sensor));
+    return lightsensor_resume(abc->sensor);
+}
+
+int abc_get_paused(struct abc_s *abc)
+{
+    return abc->paused;
+}
+
 int abc_set_target(struct abc_s *abc, int target, int ramp)
 {
     info("set target: %d, ramp: %d\n", target, ramp);
@@ -475,10 +1225,55 @@ int abc_set_target(struct abc_s *abc, int target, int ramp)
      * brightness will resume.
      */
     abc->running = false;
-    display_brightness_set(abc->display, target, ramp);
+    display_brightness_set(abc->display, target, ramp, DISPLAY_RAMP_LINEAR);
     return 0;
 }
 
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+void abc_test_feed(struct abc_s *abc, const struct sensor_light data[], int n)
+{
+    lightsensor_update_cb(data, n, abc);
+}
+
+void abc_test_set_user_point(struct abc_s *abc, int lux, int target)
+{
+    /* Points of a test controller do not replace the service's. */
+    abc->nosave = true;
+    abc_set_user_point(abc, lux, target);
+}
+
+int abc_test_get_curve_updates(struct abc_s *abc)
+{
+    return abc->job.updates;
+}
+
+void abc_test_end_session(struct abc_s *abc)
+{
+    abc->session_end = 0;
+}
+
+int abc_test_get_brightness(struct abc_s *abc, int lux)
+{
+    if (abc->job.busy || abc->nadjust > 0) {
+        return -EBUSY;
+    }
+
+    return lux_to_brightness(abc, REAL_ITOR(lux));
+}
+
+void abc_test_compute_curve(struct abc_s *abc, int lux, int target)
+{
+    compute_spline(abc, lux, target, REAL(MAX_GAMMA));
+
+    /* Built right here, so the caller measures it. */
+    if (!abc->job.busy && alloc_curve(abc) == OK) {
+        prepare_curve_job(abc);
+        abc->job.status = run_curve_job(abc);
+        finish_curve_job(abc, OK);
+    }
+}
+#endif
+
 void abc_deinit(struct abc_s *abc)
 {
     info("deinit abc: %p\n", abc);
@@ -486,12 +1281,15 @@ void abc_deinit(struct abc_s *abc)
         return;
     }
 
-    spline_destroy(abc->spline);
     lightsensor_close_device(abc->sensor);
+    stop_interactive_model(abc);
 
-    if (abc->interactive_model) {
-        stop_interactive_model(abc);
+    /* The worker may be using the curve, the job also releases abc. */
+    abc->closing = 1;
+    if (abc->job.busy) {
+        abc->closing++;
+        uv_cancel((uv_req_t *)&abc->job.work);
     }
 
-    free(abc);
+    uv_close((uv_handle_t *)&abc->interactive.timer, interactive_close_cb);
 }
@@ -27,16 +27,31 @@
 
 #include <uv.h>
 
+#include <sensor/light.h>
+
 #include "display.h"
+#include "lightsensor.h"
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Reasons to pause auto brightness, see abc_pause() */
+#define ABC_PAUSE_DISPLAY_OFF (1 << 0) /* Panel is off */
+#define ABC_PAUSE_MANUAL      (1 << 1) /* Dormant in manual mode */
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 struct abc_s;
 
+/* How auto brightness follows lux, in each direction. */
+struct abc_response_s {
+    int brighten_time;      /* ms lux must settle before brightness rises */
+    int darken_time;        /* ms lux must settle before brightness drops */
+    int brighten_threshold; /* Percent lux rise taken as a dramatic change */
+    int darken_threshold;   /* Percent lux drop taken as a dramatic change */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -46,4 +61,119 @@ void abc_deinit(struct abc_s *abc);
 int abc_set_target(struct abc_s *abc, int target, int ramp);
 int abc_set_user_point(struct abc_s *abc, int lux, int target);
 int abc_get_user_point(struct abc_s *abc, int *lux, int *target);
+
+/**
+ * @brief Get the learned user points, oldest first, the newest ones if
+ *        there are more than 'n'
+ * @param abc The controller
+ * @param lux Array to store the lux of each point
+ * @param target Array to store the brightness of each point
+ * @param n Size of the arrays
+ * @return Number of points stored, up to CONFIG_BRIGHTNESS_USER_POINTS
+ */
+int abc_get_user_points(struct abc_s *abc, int lux[], int target[], int n);
+
+/**
+ * @brief Replace the learned user points and gamma with saved ones. Unlike
+ *        abc_set_user_point() nothing is learned or saved, the curve is
+ *        built once.
+ * @param abc The controller
+ * @param lux Lux of each point, oldest first
+ * @param target Brightness of each point
+ * @param n Number of points, the newest CONFIG_BRIGHTNESS_USER_POINTS stay
+ * @param gamma Gamma from abc_get_user_gamma()
+ * @return OK, or -EINVAL if n or gamma is out of range
+ */
+int abc_set_user_points(struct abc_s *abc, const int lux[], const int target[],
+                        int n, int gamma);
+
+/**
+ * @brief Get the gamma learned from user adjustments
+ * @param abc The controller
+ * @return Gamma in 1/BRIGHTNESS_USER_GAMMA_ONE
+ */
+int abc_get_user_gamma(struct abc_s *abc);
+
+/**
+ * @brief Replace the lux filter chain, its history starts over. Times and
+ *        thresholds of hysteresis stages are taken from abc_set_response().
+ * @param abc The controller
+ * @param stages Filter stages, see lightsensor_filter_init()
+ * @param n Number of stages, 0 restores the default chain
+ * @return OK, or -EINVAL if a stage is invalid
+ */
+int abc_set_lux_filter(struct abc_s *abc,
+                       const struct lightsensor_filter_config_s stages[],
+                       int n);
+
+/**
+ * @brief Stop following lux, the sensor is unsubscribed and the filter
+ *        state is kept until all reasons are resumed
+ * @param abc The controller
+ * @param reason ABC_PAUSE_* bits
+ * @return OK
+ */
+int abc_pause(struct abc_s *abc, int reason);
+
+/**
+ * @brief Clear pause reasons. Once none is left, the last brightness is
+ *        restored and the first new sample sets brightness right away.
+ * @param abc The controller
+ * @param reason ABC_PAUSE_* bits
+ * @return OK, or a negated errno if the sensor fails to resume
+ */
+int abc_resume(struct abc_s *abc, int reason);
+
+/**
+ * @brief Get the ABC_PAUSE_* reasons set
+ * @param abc The controller
+ * @return The reasons, 0 if running
+ */
+int abc_get_paused(struct abc_s *abc);
+
+/**
+ * @brief Set brighten and darken response, the defaults are from Kconfig
+ * @param abc The controller
+ * @param response New response, NULL restores the defaults
+ * @return OK, or -EINVAL if a value is out of range
+ */
+int abc_set_response(struct abc_s *abc,
+                     const struct abc_response_s *response);
+int abc_get_response(struct abc_s *abc, struct abc_response_s *response);
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+/* Test hooks, run the controller without sensor topic and persistence. */
+void abc_test_feed(struct abc_s *abc, const struct sensor_light data[], int n);
+void abc_test_compute_curve(struct abc_s *abc, int lux, int target);
+
+/**
+ * @brief Set a user point as abc_set_user_point() does, without saving it
+ * @param abc The controller
+ * @param lux Lux of the point
+ * @param target Brightness at that lux
+ */
+void abc_test_set_user_point(struct abc_s *abc, int lux, int target);
+
+/**
+ * @brief Brightness of the curve once the user points are built into it
+ * @param abc The controller
+ * @param lux Lux to look up
+ * @return Brightness, or -EBUSY while a curve build is due
+ */
+int abc_test_get_brightness(struct abc_s *abc, int lux);
+
+/**
+ * @brief Count the curves built by editing the current one, in place of
+ *        a full rebuild with gamma applied again
+ * @param abc The controller
+ * @return Number of such curves since abc_init()
+ */
+int abc_test_get_curve_updates(struct abc_s *abc);
+
+/**
+ * @brief End the adjustment session, the next adjustment sets gamma again
+ * @param abc The controller
+ */
+void abc_test_end_session(struct abc_s *abc);
+#endif
 #endif
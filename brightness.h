@@ -30,6 +30,13 @@
 extern "C" {
 #endif
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Gamma of the auto brightness curve is given in thousandths */
+#define BRIGHTNESS_USER_GAMMA_ONE 1000
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -160,6 +167,38 @@ int brightness_set_user_point(brightness_session_t *session, int lux,
 int brightness_get_user_point(brightness_session_t *session, int *lux,
                               int *target);
 
+/**
+ * Get the auto brightness control points learned from user adjustments.
+ * @param session the brightness session instance
+ * @param lux array to store the lux value of each point
+ * @param target array to store the target brightness level of each point
+ * @param n size of the arrays
+ * @return number of points stored oldest first, negative on error
+ */
+int brightness_get_user_points(brightness_session_t *session, int lux[],
+                               int target[], int n);
+
+/**
+ * Restore auto brightness control points got from
+ * brightness_get_user_points(), and the curve gamma they left. Nothing is
+ * learned again, the curve is rebuilt once. Only valid in auto mode.
+ * @param session the brightness session instance
+ * @param lux the lux value of each point, oldest first
+ * @param target the target brightness level of each point
+ * @param n number of points
+ * @param gamma the gamma from brightness_get_user_gamma()
+ * @return 0 on success, negative on error
+ */
+int brightness_set_user_points(brightness_session_t *session, const int lux[],
+                               const int target[], int n, int gamma);
+
+/**
+ * Get the gamma user adjustments left on the auto brightness curve.
+ * @param session the brightness session instance
+ * @return gamma in 1/BRIGHTNESS_USER_GAMMA_ONE, negative on error
+ */
+int brightness_get_user_gamma(brightness_session_t *session);
+
 #ifdef __cplusplus
 } /*extern "C"*/
 #endif
@@ -20,21 +20,23 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include <sys/ioctl.h>
-
-#include <nuttx/video/fb.h>
+#include <sys/param.h>
 
 #include "brightness.h"
 #include <uv.h>
 
 #include "display.h"
+#include "display_backend.h"
 #include "private.h"
 
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
+#define RAMP_UNIT 256 /* Ramp position of one level on a linear ramp */
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -43,18 +45,79 @@
  * Private Function Prototypes
  ****************************************************************************/
 
+static void ramp_timer_cb(uv_timer_t *handle);
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
+/**
+ * Ramp position of 256 evenly spaced levels for DISPLAY_RAMP_PERCEPTUAL,
+ * CIE 1976 lightness of the level taken as relative luminance, scaled so
+ * that the last entry is at 255 * RAMP_UNIT:
+ * L* = 116 * Y^(1/3) - 16, or Y * 903.3 below Y = 0.008856.
+ */
+/* clang-format off */
+static const uint16_t g_perceptual_ramp[256] = {
+    0, 2312, 4625, 6778, 8511, 9975, 11254, 12398,
+    13438, 14394, 15282, 16113, 16894, 17634, 18336, 19005,
+    19646, 20260, 20851, 21420, 21969, 22501, 23016, 23515,
+    24000, 24472, 24932, 25380, 25817, 26243, 26660, 27068,
+    27467, 27858, 28241, 28617, 28985, 29347, 29702, 30051,
+    30394, 30732, 31064, 31391, 31713, 32030, 32342, 32650,
+    32953, 33253, 33548, 33839, 34127, 34411, 34691, 34968,
+    35242, 35512, 35779, 36043, 36305, 36563, 36818, 37071,
+    37321, 37569, 37814, 38056, 38296, 38534, 38769, 39003,
+    39234, 39463, 39690, 39914, 40137, 40358, 40577, 40794,
+    41009, 41223, 41435, 41645, 41853, 42060, 42265, 42468,
+    42670, 42871, 43070, 43267, 43463, 43658, 43851, 44043,
+    44234, 44423, 44611, 44797, 44983, 45167, 45350, 45531,
+    45712, 45891, 46070, 46247, 46423, 46598, 46772, 46945,
+    47117, 47287, 47457, 47626, 47794, 47961, 48127, 48292,
+    48456, 48619, 48781, 48942, 49103, 49263, 49421, 49579,
+    49736, 49893, 50048, 50203, 50357, 50510, 50662, 50814,
+    50965, 51115, 51265, 51413, 51561, 51709, 51855, 52001,
+    52146, 52291, 52435, 52578, 52721, 52862, 53004, 53144,
+    53285, 53424, 53563, 53701, 53839, 53976, 54112, 54248,
+    54384, 54518, 54653, 54786, 54919, 55052, 55184, 55315,
+    55446, 55577, 55707, 55836, 55965, 56094, 56222, 56349,
+    56476, 56603, 56729, 56854, 56979, 57104, 57228, 57352,
+    57475, 57598, 57720, 57842, 57964, 58085, 58206, 58326,
+    58446, 58565, 58684, 58803, 58921, 59038, 59156, 59273,
+    59389, 59506, 59621, 59737, 59852, 59967, 60081, 60195,
+    60308, 60422, 60534, 60647, 60759, 60871, 60982, 61093,
+    61204, 61314, 61425, 61534, 61644, 61753, 61861, 61970,
+    62078, 62186, 62293, 62400, 62507, 62614, 62720, 62826,
+    62931, 63036, 63141, 63246, 63351, 63455, 63558, 63662,
+    63765, 63868, 63971, 64073, 64175, 64277, 64378, 64480,
+    64581, 64681, 64782, 64882, 64982, 65082, 65181, 65280,
+};
+/* clang-format on */
+
+/* Backends by device path, the first that takes the path is used. */
+static const struct display_backend_s *const g_display_backends[] = {
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_SYSFS
+    &g_display_sysfs_backend,
+#endif
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_MOCK
+    &g_display_mock_backend,
+#endif
+    &g_display_fb_backend, /* Takes any path, keep it last */
+};
+
 struct display_brightness_s {
-    int fd;                /* file descriptor to the frame buffer device */
+    /* Backlight device and its backend */
+    struct display_device_s dev;
     uv_loop_t *loop;       /* libuv loop */
     int target;            /* target brightness */
     int current;           /* current brightness */
-    float ramp;            /* ramp rate per timer callback */
-    int steps;             /* How may steps have been made. */
+    int ramp;              /* ramp rate in levels per second */
+    uint64_t start_time;   /* ramp start in ms, uv_now() */
+    uint64_t end_time;     /* planned ramp end in ms, uv_now() */
     int start_brightness;  /* start brightness of ramp */
+    const uint16_t *curve; /* Ramp position of each level, NULL if linear */
+    bool has_fade;         /* Driver fades on its own, see FBIOSET_FADE */
+    bool fading;           /* Driver fade to target in progress */
     uv_timer_t ramp_timer; /* Timer to smoothly change brightness */
     brightness_update_cb_t *cb;
     void *user_data;
@@ -73,7 +136,7 @@ static int write_brightness(struct display_brightness_s *display,
         return OK;
 
     info("Set brightness to %d\n", brightness);
-    ret = ioctl(display->fd, FBIOSET_POWER, brightness);
+    ret = display->dev.backend->write(&display->dev, brightness);
     if (ret < 0) {
         err("Failed to set brightness, %d\n", ret);
         return ret;
@@ -91,7 +154,7 @@ static int read_brightness(struct display_brightness_s *display,
 {
     int ret;
 
-    ret = ioctl(display->fd, FBIOGET_POWER, brightness);
+    ret = display->dev.backend->read(&display->dev, brightness);
     if (ret < 0) {
         err("Failed to read brightness, %d\n", ret);
         return ret;
@@ -100,26 +163,185 @@ static int read_brightness(struct display_brightness_s *display,
     return 0;
 }
 
+/* Stop a driver fade at the level it reached. */
+static void stop_fade(struct display_brightness_s *display)
+{
+    int brightness;
+    int ret;
+
+    display->fading = false;
+    ret = read_brightness(display, &brightness);
+    if (ret < 0) {
+        return;
+    }
+
+    ret = display->dev.backend->write(&display->dev, brightness);
+    if (ret < 0) {
+        err("Failed to stop fade, %d\n", ret);
+        return;
+    }
+
+    if (display->current != brightness) {
+        display->current = brightness;
+        if (display->cb) {
+            display->cb(BRIGHTNESS_MONITOR_LEVEL, brightness,
+                        display->user_data);
+        }
+    }
+}
+
+static void fade_timer_cb(uv_timer_t *handle)
+{
+    struct display_brightness_s *display = handle->data;
+    int brightness;
+
+    display->fading = false;
+    if (read_brightness(display, &brightness) < 0) {
+        brightness = display->target;
+    }
+
+    if (display->current != brightness) {
+        display->current = brightness;
+        if (display->cb) {
+            display->cb(BRIGHTNESS_MONITOR_LEVEL, brightness,
+                        display->user_data);
+        }
+    }
+
+    /* Finish a fade the driver has not completed on time. */
+    write_brightness(display, display->target);
+}
+
+/* Hand the ramp to the driver, which takes one call and one wakeup. */
+static int start_fade(struct display_brightness_s *display)
+{
+    struct display_fade_s fade;
+    int ret;
+
+    fade.level = display->target;
+    fade.duration = display->end_time - display->start_time;
+    ret = display->dev.backend->fade(&display->dev, &fade);
+    if (ret < 0) {
+        err("Failed to fade, %d\n", ret);
+        return ret;
+    }
+
+    display->fading = true;
+    uv_timer_start(&display->ramp_timer, fade_timer_cb, fade.duration, 0);
+    return 0;
+}
+
+static const struct display_backend_s *find_backend(const char *path)
+{
+    const struct display_backend_s *backend;
+    int i;
+
+    for (i = 0; i < nitems(g_display_backends); i++) {
+        backend = g_display_backends[i];
+        if (strncmp(path, backend->prefix, strlen(backend->prefix)) == 0) {
+            break;
+        }
+    }
+
+    return backend;
+}
+
 static void timer_close_cb(uv_handle_t *handle)
 {
     struct display_brightness_s *display = handle->data;
     free(display);
 }
 
+static int clamp_level(int level)
+{
+    return MIN(MAX(level, 0), BACKLIGHT_LEVEL_MAX);
+}
+
+/**
+ * Ramps move at a constant rate in positions. They are levels times
+ * RAMP_UNIT on a linear ramp. Other curves interpolate a table that spans
+ * 0 to BACKLIGHT_LEVEL_MAX, whatever the number of levels, so there is no
+ * math per step beyond that. Levels must be in that range.
+ */
+static uint32_t ramp_position(struct display_brightness_s *display,
+                              int level)
+{
+    uint32_t last = nitems(g_perceptual_ramp) - 1;
+    uint64_t position;
+    uint32_t index;
+    uint32_t frac;
+
+    if (display->curve == NULL) {
+        return level * RAMP_UNIT;
+    }
+
+    /* Table index in 1/BACKLIGHT_LEVEL_MAX steps */
+    index = (uint32_t)level * last / BACKLIGHT_LEVEL_MAX;
+    frac = (uint32_t)level * last % BACKLIGHT_LEVEL_MAX;
+    position = display->curve[index];
+    if (index < last) {
+        position += (uint64_t)(display->curve[index + 1] - position) * frac /
+                    BACKLIGHT_LEVEL_MAX;
+    }
+
+    /* Full level at the same position as on a linear ramp */
+    return position * BACKLIGHT_LEVEL_MAX / last;
+}
+
+/* Distance from ramp start to a level, in positions */
+static uint32_t ramp_distance(struct display_brightness_s *display,
+                              int level)
+{
+    uint32_t start = ramp_position(display, display->start_brightness);
+    uint32_t position = ramp_position(display, level);
+
+    return position > start ? position - start : start - position;
+}
+
+/* Time in ms from ramp start until it has moved 'distance' positions */
+static uint64_t ramp_time(struct display_brightness_s *display,
+                          uint32_t distance)
+{
+    uint64_t rate = (uint64_t)display->ramp * RAMP_UNIT;
+
+    return ((uint64_t)distance * 1000 + rate - 1) / rate;
+}
+
+/**
+ * Wake up when the ramp reaches its next level, as a slow ramp would
+ * otherwise wake up to write the same level again.
+ */
+static void schedule_ramp(struct display_brightness_s *display, int next,
+                          uint64_t now)
+{
+    uint64_t time = display->start_time +
+                    ramp_time(display, ramp_distance(display, next));
+
+    time = MAX(time, now + DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD);
+    uv_timer_start(&display->ramp_timer, ramp_timer_cb, time - now, 0);
+}
+
 static void ramp_timer_cb(uv_timer_t *handle)
 {
     struct display_brightness_s *display = handle->data;
+    uint64_t now = uv_now(display->loop);
+    int step = display->target > display->start_brightness ? 1 : -1;
+    uint64_t moved;
     int current;
     int ret;
 
-    display->steps++;
-
-    current = display->start_brightness + (int)(display->steps * display->ramp);
+    /* Position follows the time since start, so a late tick catches up. */
+    moved = (now - display->start_time) * display->ramp * RAMP_UNIT / 1000;
+    current = clamp_level(display->current);
+    while (current != display->target &&
+           ramp_distance(display, current + step) <= moved) {
+        current += step;
+    }
 
-    if ((display->ramp > 0 && current >= display->target) ||
-        (display->ramp < 0 && current <= display->target)) {
+    if (now < display->end_time && current != display->target) {
+        schedule_ramp(display, current + step, now);
+    } else {
         current = display->target;
-        uv_timer_stop(handle);
     }
 
     ret = write_brightness(display, current);
@@ -136,8 +358,9 @@ static void ramp_timer_cb(uv_timer_t *handle)
 struct display_brightness_s *display_brightness_open_device(const char *devpath,
                                                             uv_loop_t *loop)
 {
+    const struct display_backend_s *backend = find_backend(devpath);
     struct display_brightness_s *display;
-    int fd;
+    struct display_fade_s fade;
     int brightness;
     int ret;
 
@@ -147,25 +370,30 @@ struct display_brightness_s *display_brightness_open_device(const char *devpath,
         return NULL;
     }
 
-    fd = open(devpath, O_RDWR | O_CLOEXEC);
-    if (fd < 0) {
+    display->dev.backend = backend;
+    display->dev.loop = loop;
+    ret = backend->open(&display->dev, devpath);
+    if (ret < 0) {
         free(display);
-        err("Failed to open %s, %d\n", devpath, errno);
+        err("Failed to open %s, %d\n", devpath, ret);
         return NULL;
     }
 
     display->loop = loop;
-    display->fd = fd;
 
     ret = read_brightness(display, &brightness);
     if (ret < 0) {
         err("Failed to read brightness, %d\n", ret);
+        backend->close(&display->dev);
         free(display);
-        close(fd);
         return NULL;
     }
 
     display->current = brightness;
+    display->has_fade =
+        backend->get_fade && backend->get_fade(&display->dev, &fade) >= 0;
+    info("Backend %s, driver fade %s\n", backend->name,
+         display->has_fade ? "found" : "not found");
     uv_timer_init(loop, &display->ramp_timer);
     display->ramp_timer.data = display;
 
@@ -173,10 +401,14 @@ struct display_brightness_s *display_brightness_open_device(const char *devpath,
 }
 
 int display_brightness_set(struct display_brightness_s *display, int brightness,
-                           int ramp)
+                           int ramp, enum display_ramp_curve_e curve)
 {
     int set = brightness;
+
     uv_timer_stop(&display->ramp_timer);
+    if (display->fading) {
+        stop_fade(display);
+    }
 
     if (ramp == BRIGHTNESS_RAMP_SPEED_DEFAULT) {
 #ifdef CONFIG_BRIGHTNESS_RAMP_SPEED_DEFAULT
@@ -192,7 +424,7 @@ int display_brightness_set(struct display_brightness_s *display, int brightness,
     if (brightness == BRIGHTNESS_LEVEL_OFF) {
         brightness = 0;
     } else if (brightness == BRIGHTNESS_LEVEL_FULL) {
-        brightness = 255;
+        brightness = BACKLIGHT_LEVEL_MAX;
     }
     /* Limit the brightness value */
     else if (brightness > BACKLIGHT_LEVEL_MAX) {
@@ -206,20 +438,35 @@ int display_brightness_set(struct display_brightness_s *display, int brightness,
     syslog(LOG_INFO, "Set brightness to %d(clamp: %d), ramp %d\n", set,
            brightness, ramp);
 
-    if (ramp == 0) {
+    uv_update_time(display->loop);
+    display->start_time = uv_now(display->loop);
+    display->end_time = display->start_time;
+    if (ramp <= 0) {
         display->ramp = 0;
         return write_brightness(display, brightness);
     } else {
-        uv_update_time(display->loop);
-        display->ramp = ramp / 1000.f * DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD;
-        if (brightness < display->current) {
-            display->ramp = -display->ramp;
+        /* Plan the end from the distance, wakeups only sample the ramp. */
+        display->ramp = ramp;
+        display->curve =
+            curve == DISPLAY_RAMP_PERCEPTUAL ? g_perceptual_ramp : NULL;
+        display->start_brightness = clamp_level(display->current);
+        if (display->start_brightness == brightness) {
+            /* Nothing to ramp, a level out of range is corrected at once. */
+            return write_brightness(display, brightness);
         }
-        display->steps = 0;
-        display->start_brightness = display->current;
-        uv_timer_start(&display->ramp_timer, ramp_timer_cb,
-                       DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD,
-                       DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD);
+
+        display->end_time +=
+            ramp_time(display, ramp_distance(display, brightness));
+        if (display->has_fade && curve == DISPLAY_RAMP_LINEAR &&
+            start_fade(display) == 0) {
+            return 0;
+        }
+
+        schedule_ramp(display,
+                      brightness > display->start_brightness
+                          ? display->start_brightness + 1
+                          : display->start_brightness - 1,
+                      display->start_time);
     }
 
     return 0;
@@ -228,10 +475,22 @@ int display_brightness_set(struct display_brightness_s *display, int brightness,
 int display_brightness_get(struct display_brightness_s *display,
                            int *brightness)
 {
+    /* The driver knows how far its fade got. */
+    if (display->fading) {
+        return read_brightness(display, brightness);
+    }
+
     *brightness = display->current;
     return 0;
 }
 
+int display_brightness_get_ramp_end(struct display_brightness_s *display,
+                                    uint64_t *end_time)
+{
+    *end_time = display->end_time;
+    return 0;
+}
+
 void display_brightness_close_device(struct display_brightness_s *display)
 {
     if (display == NULL) {
@@ -240,7 +499,18 @@ void display_brightness_close_device(struct display_brightness_s *display)
 
     uv_timer_stop(&display->ramp_timer);
     uv_close((uv_handle_t *)&display->ramp_timer, timer_close_cb);
-    close(display->fd);
+    display->dev.backend->close(&display->dev);
+}
+
+struct display_device_s *display_brightness_get_device(
+    struct display_brightness_s *display)
+{
+    return &display->dev;
+}
+
+bool display_brightness_has_fade(struct display_brightness_s *display)
+{
+    return display->has_fade;
 }
 
 int display_brightness_set_update_cb(struct display_brightness_s *display,
@@ -25,6 +25,8 @@
  * Included Files
  ****************************************************************************/
 
+#include <stdbool.h>
+
 #include <uv.h>
 
 #include "brightness.h"
@@ -36,27 +38,113 @@
 /* change power level by 10 per second */
 #define DISPLAY_BRIGHTNESS_RAMP_SPEED_DEFAULT 50
 
-#define DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD 50 /* 50ms per step */
+#define DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD 50 /* Shortest ms per step */
+
+#define DISPLAY_MOCK_WRITES_MAX 256 /* Writes a mock display keeps */
+
+/**
+ * Backlight drivers that fade on their own take a whole linear ramp in one
+ * call. The argument is a struct display_fade_s. FBIOSET_FADE starts a fade
+ * from the level the driver holds, FBIOSET_POWER stops it, and
+ * FBIOGET_POWER returns the level reached so far. FBIOGET_FADE returns the
+ * fade in progress, 'duration' is 0 if there is none. Drivers without them
+ * fail with -ENOTTY and ramps run on a timer.
+ *
+ * Upstream NuttX has no fade ioctls yet, these numbers are a proposal and
+ * are only used with CONFIG_BRIGHTNESS_DISPLAY_FADE. Definitions from
+ * nuttx/video/fb.h take precedence.
+ */
+#ifndef FBIOSET_FADE
+#define FBIOSET_FADE _FBIOC(0x00f0)
+#define FBIOGET_FADE _FBIOC(0x00f1)
+#endif
 
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 struct display_brightness_s;
 
+struct display_fade_s {
+    int level;         /* Level at the end of the fade */
+    uint32_t duration; /* Fade time in ms, 0 to set at once */
+};
+
+/* Backlight write of a mock display */
+struct display_mock_write_s {
+    uint64_t time; /* uv_now() of the write in ms */
+    int level;
+};
+
+/* How a ramp moves from level to level */
+enum display_ramp_curve_e {
+    DISPLAY_RAMP_LINEAR = 0, /* Same time for each level */
+    DISPLAY_RAMP_PERCEPTUAL, /* Same time for each step of CIE L* lightness */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
 
+/**
+ * @brief Open the backlight of a display
+ * @param path Frame buffer device such as "/dev/fb0", a Linux backlight
+ *        such as "/sys/class/backlight/<name>" with
+ *        CONFIG_BRIGHTNESS_DISPLAY_SYSFS, or "mock[:<level>]" with
+ *        CONFIG_BRIGHTNESS_DISPLAY_MOCK
+ * @param loop Loop that runs the ramps
+ * @return The display, or NULL on error
+ */
 struct display_brightness_s *display_brightness_open_device(const char *path,
                                                             uv_loop_t *loop);
 
+/**
+ * @brief Set the brightness, at once or with a ramp. Linear ramps are
+ *        handed to the driver if it fades on its own.
+ * @param display The display
+ * @param brightness Level to set, or BRIGHTNESS_LEVEL_DEFAULT/OFF
+ * @param ramp Levels per second, 0 to set at once. On a perceptual ramp
+ *        they are levels of lightness mapped to the 0-255 range, so a full
+ *        range ramp takes as long as a linear one.
+ * @param curve How the ramp moves from level to level
+ * @return 0, or a negated errno of the device
+ */
 int display_brightness_set(struct display_brightness_s *display, int brightness,
-                           int ramp);
+                           int ramp, enum display_ramp_curve_e curve);
 int display_brightness_get(struct display_brightness_s *display,
                            int *brightness);
+
+/**
+ * @brief Get when the last set brightness is reached
+ * @param display The display
+ * @param end_time Planned end of the ramp in ms of uv_now(), the set time
+ *        if there is no ramp. It holds however late the ramp timer runs.
+ * @return 0
+ */
+int display_brightness_get_ramp_end(struct display_brightness_s *display,
+                                    uint64_t *end_time);
 void display_brightness_close_device(struct display_brightness_s *dev);
 
+/**
+ * @brief Check if ramps are handed to the driver
+ * @param display The display
+ * @return True if the driver fades on its own, probed at open
+ */
+bool display_brightness_has_fade(struct display_brightness_s *display);
+
 int display_brightness_set_update_cb(struct display_brightness_s *display,
                                      brightness_update_cb_t *cb,
                                      void *user_data);
+
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_MOCK
+/**
+ * @brief Get the backlight writes of a mock display
+ * @param display The display, opened with a "mock" path
+ * @param writes Array to store the writes, oldest first. Only the first
+ *        DISPLAY_MOCK_WRITES_MAX writes are kept.
+ * @param n Size of the array
+ * @return Number of writes since open, -EINVAL if it is not a mock
+ */
+int display_mock_get_writes(struct display_brightness_s *display,
+                            struct display_mock_write_s writes[], int n);
+#endif
 #endif
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Backlight backends of display.c. Each backend reads and writes the
+ * backlight of one kind of device, the device path picks the backend.
+ */
+
+#ifndef _BRIGHTNESS_DISPLAY_BACKEND_H
+#define _BRIGHTNESS_DISPLAY_BACKEND_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <uv.h>
+
+#include "display.h"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+struct display_backend_s;
+
+/* Backlight device of a display, state is up to the backend. */
+struct display_device_s {
+    const struct display_backend_s *backend;
+    uv_loop_t *loop; /* Loop of the display, for timestamps */
+    int fd;          /* Device, -1 if the backend has none */
+    int max;         /* Device level of full brightness */
+    void *priv;
+};
+
+struct display_backend_s {
+    const char *name;
+    const char *prefix; /* Device paths the backend takes, "" for any */
+
+    /**
+     * @brief Open the device, 'loop' is set
+     * @return 0, or a negated errno
+     */
+    int (*open)(struct display_device_s *dev, const char *path);
+    void (*close)(struct display_device_s *dev);
+
+    /* Levels are 0 to BACKLIGHT_LEVEL_MAX, 0 on success or a negated errno */
+    int (*write)(struct display_device_s *dev, int brightness);
+    int (*read)(struct display_device_s *dev, int *brightness);
+
+    /* Driver fade, see FBIOSET_FADE. NULL if the backend has none. */
+    int (*fade)(struct display_device_s *dev,
+                const struct display_fade_s *fade);
+    int (*get_fade)(struct display_device_s *dev,
+                    struct display_fade_s *fade);
+};
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+extern const struct display_backend_s g_display_fb_backend;
+
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_SYSFS
+extern const struct display_backend_s g_display_sysfs_backend;
+#endif
+
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_MOCK
+extern const struct display_backend_s g_display_mock_backend;
+#endif
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+/**
+ * @brief Get the backlight device of a display
+ * @param display The display
+ * @return The device
+ */
+struct display_device_s *display_brightness_get_device(
+    struct display_brightness_s *display);
+
+#endif
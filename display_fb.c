@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Frame buffer backlight, FBIOSET_POWER and FBIOGET_POWER on an fb device.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+
+#include <nuttx/video/fb.h>
+
+#include "display_backend.h"
+#include "private.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int fb_open(struct display_device_s *dev, const char *path)
+{
+    dev->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (dev->fd < 0) {
+        err("Failed to open %s, %d\n", path, errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+static void fb_close(struct display_device_s *dev)
+{
+    close(dev->fd);
+}
+
+static int fb_write(struct display_device_s *dev, int brightness)
+{
+    return ioctl(dev->fd, FBIOSET_POWER, brightness) < 0 ? -errno : 0;
+}
+
+static int fb_read(struct display_device_s *dev, int *brightness)
+{
+    return ioctl(dev->fd, FBIOGET_POWER, brightness) < 0 ? -errno : 0;
+}
+
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_FADE
+static int fb_fade(struct display_device_s *dev,
+                   const struct display_fade_s *fade)
+{
+    return ioctl(dev->fd, FBIOSET_FADE, fade) < 0 ? -errno : 0;
+}
+
+static int fb_get_fade(struct display_device_s *dev,
+                       struct display_fade_s *fade)
+{
+    return ioctl(dev->fd, FBIOGET_FADE, fade) < 0 ? -errno : 0;
+}
+#endif
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+const struct display_backend_s g_display_fb_backend = {
+    .name = "fb",
+    .prefix = "",
+    .open = fb_open,
+    .close = fb_close,
+    .write = fb_write,
+    .read = fb_read,
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_FADE
+    .fade = fb_fade,
+    .get_fade = fb_get_fade,
+#endif
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * In-memory backlight for tests, it records each write with the loop time.
+ * The device path is "mock", or "mock:<level>" to start at that level.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/param.h>
+
+#include "display_backend.h"
+#include "private.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct display_mock_s {
+    int level;
+    int nwrites; /* All writes, the first DISPLAY_MOCK_WRITES_MAX are kept */
+    struct display_mock_write_s writes[DISPLAY_MOCK_WRITES_MAX];
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int mock_open(struct display_device_s *dev, const char *path)
+{
+    struct display_mock_s *mock;
+    const char *level = strchr(path, ':');
+
+    mock = zalloc(sizeof(struct display_mock_s));
+    if (mock == NULL) {
+        return -ENOMEM;
+    }
+
+    mock->level = level ? atoi(level + 1) : 0;
+    dev->fd = -1;
+    dev->priv = mock;
+    return 0;
+}
+
+static void mock_close(struct display_device_s *dev)
+{
+    free(dev->priv);
+}
+
+static int mock_write(struct display_device_s *dev, int brightness)
+{
+    struct display_mock_s *mock = dev->priv;
+
+    if (mock->nwrites < DISPLAY_MOCK_WRITES_MAX) {
+        mock->writes[mock->nwrites].time = uv_now(dev->loop);
+        mock->writes[mock->nwrites].level = brightness;
+    }
+
+    mock->nwrites++;
+    mock->level = brightness;
+    return 0;
+}
+
+static int mock_read(struct display_device_s *dev, int *brightness)
+{
+    struct display_mock_s *mock = dev->priv;
+
+    *brightness = mock->level;
+    return 0;
+}
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+const struct display_backend_s g_display_mock_backend = {
+    .name = "mock",
+    .prefix = "mock",
+    .open = mock_open,
+    .close = mock_close,
+    .write = mock_write,
+    .read = mock_read,
+};
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int display_mock_get_writes(struct display_brightness_s *display,
+                            struct display_mock_write_s writes[], int n)
+{
+    struct display_device_s *dev = display_brightness_get_device(display);
+    struct display_mock_s *mock = dev->priv;
+
+    if (dev->backend != &g_display_mock_backend) {
+        return -EINVAL;
+    }
+
+    n = MIN(n, MIN(mock->nwrites, DISPLAY_MOCK_WRITES_MAX));
+    memcpy(writes, mock->writes, n * sizeof(writes[0]));
+    return mock->nwrites;
+}
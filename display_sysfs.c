@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Linux backlight class, /sys/class/backlight/<name>. The brightness file
+ * stays open and each level is one pwrite(). Levels 0 to BACKLIGHT_LEVEL_MAX
+ * are scaled to the max_brightness of the device.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "display_backend.h"
+#include "private.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define SYSFS_VALUE_MAX 16 /* Decimal level and a newline */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int read_value(int fd, int *value)
+{
+    char buf[SYSFS_VALUE_MAX];
+    ssize_t len;
+
+    len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        return len < 0 ? -errno : -EIO;
+    }
+
+    buf[len] = '\0';
+    *value = atoi(buf);
+    return 0;
+}
+
+static int sysfs_open(struct display_device_s *dev, const char *path)
+{
+    char file[PATH_MAX];
+    int fd;
+    int ret;
+
+    snprintf(file, sizeof(file), "%s/max_brightness", path);
+    fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err("Failed to open %s, %d\n", file, errno);
+        return -errno;
+    }
+
+    ret = read_value(fd, &dev->max);
+    close(fd);
+    if (ret < 0 || dev->max <= 0) {
+        err("Failed to read %s, %d\n", file, ret);
+        return ret < 0 ? ret : -EINVAL;
+    }
+
+    snprintf(file, sizeof(file), "%s/brightness", path);
+    dev->fd = open(file, O_RDWR | O_CLOEXEC);
+    if (dev->fd < 0) {
+        err("Failed to open %s, %d\n", file, errno);
+        return -errno;
+    }
+
+    info("Backlight %s, max brightness %d\n", path, dev->max);
+    return 0;
+}
+
+static void sysfs_close(struct display_device_s *dev)
+{
+    close(dev->fd);
+}
+
+static int sysfs_write(struct display_device_s *dev, int brightness)
+{
+    char buf[SYSFS_VALUE_MAX];
+    ssize_t ret;
+    int value;
+    int len;
+
+    value = (brightness * dev->max + BACKLIGHT_LEVEL_MAX / 2) /
+            BACKLIGHT_LEVEL_MAX;
+    len = snprintf(buf, sizeof(buf), "%d\n", value);
+    ret = pwrite(dev->fd, buf, len, 0);
+    if (ret != len) {
+        return ret < 0 ? -errno : -EIO;
+    }
+
+    return 0;
+}
+
+static int sysfs_read(struct display_device_s *dev, int *brightness)
+{
+    int value;
+    int ret;
+
+    ret = read_value(dev->fd, &value);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *brightness = (value * BACKLIGHT_LEVEL_MAX + dev->max / 2) / dev->max;
+    return 0;
+}
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+const struct display_backend_s g_display_sysfs_backend = {
+    .name = "sysfs",
+    .prefix = "/sys/class/backlight/",
+    .open = sysfs_open,
+    .close = sysfs_close,
+    .write = sysfs_write,
+    .read = sysfs_read,
+};
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#include "fixedpoint.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Mantissas are kept in Q30, in range [1, 2). */
+#define Q30_ONE (UINT32_C(1) << 30)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* 2^(2^-i) for i from 1 to 16, in Q30. */
+static const uint32_t g_exp2_bits[16] = {
+    1518500250, 1276901417, 1170923762, 1121280436, 1097253708, 1085434106,
+    1079572136, 1076653033, 1075196443, 1074468888, 1074105294, 1073923544,
+    1073832680, 1073787251, 1073764537, 1073753181,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static inline uint32_t q30_mul(uint32_t a, uint32_t b)
+{
+    return ((uint64_t)a * b) >> 30;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+b16_t b16log2(b16_t x)
+{
+    uint32_t m;
+    b16_t result;
+    int e;
+
+    if (x <= 0) {
+        return b16MIN;
+    }
+
+    /* x = m * 2^e with m in [1, 2), the integer part of result is e. */
+    m = x;
+    e = 14;
+    while (m < Q30_ONE) {
+        m <<= 1;
+        e--;
+    }
+
+    /* Each squaring of m shifts one fraction bit of log2(m) in. */
+    result = e * b16ONE;
+    for (b16_t bit = b16HALF; bit > 0; bit >>= 1) {
+        m = q30_mul(m, m);
+        if (m >= 2 * Q30_ONE) {
+            m >>= 1;
+            result += bit;
+        }
+    }
+
+    return result;
+}
+
+b16_t b16exp2(b16_t x)
+{
+    uint32_t m = Q30_ONE;
+    int e = b16toi(x);
+    int shift;
+
+    /* 2^x = 2^e * product of 2^(2^-i) over the fraction bits set. */
+    for (int i = 0; i < 16; i++) {
+        if (x & (b16HALF >> i)) {
+            m = q30_mul(m, g_exp2_bits[i]);
+        }
+    }
+
+    /* m is in Q30, result in Q16 */
+    if (e >= 15) {
+        return b16MAX;
+    }
+
+    shift = 14 - e;
+    if (shift >= 32) {
+        return 0;
+    }
+
+    return shift > 0 ? (m + (UINT32_C(1) << (shift - 1))) >> shift : m;
+}
+
+b16_t b16pow(b16_t x, b16_t y)
+{
+    if (x <= 0) {
+        return 0;
+    }
+
+    return b16exp2(b16mulb16(y, b16log2(x)));
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Number type of the auto brightness control path. It is float, or Q16
+ * fixed-point with CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT for MCUs without FPU.
+ */
+
+#ifndef _BRIGHTNESS_FIXEDPOINT_H
+#define _BRIGHTNESS_FIXEDPOINT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <math.h>
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+#include <fixedmath.h>
+#endif
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+
+/* Largest lux the Q16 engine handles, brighter light is clamped. */
+#define REAL_LUX_MAX 32767
+
+/* clang-format off */
+#define REAL(f)             ((b16_t)((f) * (double)b16ONE))
+#define REAL_ITOR(i)        ((b16_t)(i) * b16ONE)
+#define REAL_TOI(r)         b16toi(r)
+#define REAL_TOF(r)         b16tof(r)
+#define REAL_FTOR(f)        ftob16(f)
+#define REAL_MUL(a, b)      b16mulb16(a, b)
+#define REAL_DIV(a, b)      b16divb16(a, b)
+#define REAL_ABS(a)         ((a) < 0 ? -(a) : (a))
+#define REAL_LOG2(a)        b16log2(a)
+#define REAL_POW(a, b)      b16pow(a, b)
+#define REAL_RATIO(a, b)    ((b16_t)(((int64_t)(a) << 16) / (int64_t)(b)))
+/* clang-format on */
+
+#else
+
+/* clang-format off */
+#define REAL(f)             (f)
+#define REAL_ITOR(i)        ((float)(i))
+#define REAL_TOI(r)         ((int)(r))
+#define REAL_TOF(r)         (r)
+#define REAL_FTOR(f)        (f)
+#define REAL_MUL(a, b)      ((a) * (b))
+#define REAL_DIV(a, b)      ((a) / (b))
+#define REAL_ABS(a)         fabsf(a)
+#define REAL_LOG2(a)        log2f(a)
+#define REAL_POW(a, b)      powf(a, b)
+#define REAL_RATIO(a, b)    ((float)(a) / (float)(b))
+/* clang-format on */
+
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+typedef b16_t real_t;
+#else
+typedef float real_t;
+#endif
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+
+/**
+ * @brief Base 2 logarithm in Q16
+ * @param x Value, must be positive
+ * @return log2(x), within 2^-15 of the exact value. b16MIN if x <= 0.
+ */
+b16_t b16log2(b16_t x);
+
+/**
+ * @brief Base 2 exponential in Q16
+ * @param x Exponent
+ * @return 2^x rounded to Q16, with an additional relative error below
+ *      2^-26. Saturates to b16MAX when 2^x does not fit.
+ */
+b16_t b16exp2(b16_t x);
+
+/**
+ * @brief Power function in Q16
+ * @param x Base, must be positive
+ * @param y Exponent, y * log2(x) must fit in Q16
+ * @return x^y, 0 if x <= 0
+ */
+b16_t b16pow(b16_t x, b16_t y);
+
+/**
+ * @brief Convert a float lux value to Q16
+ * @param lux Lux value
+ * @return Lux clamped to [0, REAL_LUX_MAX] in Q16
+ */
+static inline b16_t b16lux(float lux)
+{
+    if (!(lux > 0.0f)) {
+        return 0;
+    }
+
+    return lux < REAL_LUX_MAX ? ftob16(lux) : itob16(REAL_LUX_MAX);
+}
+
+#define REAL_LUX(f) b16lux(f)
+#else
+#define REAL_LUX(f) (f)
+#endif
+
+#endif
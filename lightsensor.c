@@ -18,6 +18,11 @@
  * Included Files
  ****************************************************************************/
 
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
 #include "lightsensor.h"
 #include "private.h"
 
@@ -37,9 +42,12 @@
  * Private Data
  ****************************************************************************/
 struct lightsensor_s {
-    uv_topic_t topic;
+    uv_loop_t *loop;
+    orb_id_t meta;
+    uv_topic_t *topic; /* NULL while paused */
     void (*update_cb)(const struct sensor_light[], int n, void *);
     void *user_data;
+    unsigned int frequency;
 };
 
 /****************************************************************************
@@ -52,20 +60,280 @@ static void lightsensor_topic_cb(uv_topic_t *topic, int status, void *data,
     int count = datalen / sizeof(struct sensor_light);
     struct lightsensor_s *sensor = (void *)topic->flags;
 
-    /**
-     * @todo
-     * Sensor data debounce and filter.
-     * Add threshold to bypass filter for dramatic changes.
-     */
+    /* Raw samples, users filter them with lightsensor_filter_update(). */
     sensor->update_cb(data, count, sensor->user_data);
 }
 
+static real_t median_update(struct lightsensor_filter_stage_s *stage,
+                            real_t lux)
+{
+    struct lightsensor_median_s *median = &stage->state.median;
+    int window = stage->config.median.window;
+    real_t *sorted = median->sorted;
+    int n = median->n;
+    int i;
+
+    /* Take the oldest sample out of the sorted window. */
+    if (n == window) {
+        for (i = 0; i < n - 1 && sorted[i] != median->ring[median->pos]; i++)
+            ;
+
+        memmove(&sorted[i], &sorted[i + 1], (n - i - 1) * sizeof(real_t));
+        n--;
+    }
+
+    for (i = n; i > 0 && sorted[i - 1] > lux; i--) {
+        sorted[i] = sorted[i - 1];
+    }
+
+    sorted[i] = lux;
+    n++;
+
+    median->ring[median->pos] = lux;
+    median->pos = (median->pos + 1) % window;
+    median->n = n;
+
+    if (n & 1) {
+        return sorted[n / 2];
+    }
+
+    return sorted[n / 2 - 1] +
+           REAL_MUL(sorted[n / 2] - sorted[n / 2 - 1], REAL(0.5f));
+}
+
+/* Smoothing factor of an EMA with time constant 'tau' ms over 'dt' us */
+static inline real_t ema_factor(uint32_t tau, uint32_t dt)
+{
+    if (tau == 0) {
+        return REAL(1);
+    }
+
+    return REAL_RATIO(dt, (uint64_t)tau * 1000 + dt);
+}
+
+static real_t ema_update(struct lightsensor_filter_stage_s *stage,
+                         uint32_t dt, real_t lux)
+{
+    struct lightsensor_ema_s *ema = &stage->state.ema;
+    real_t factor = ema_factor(stage->config.ema.tau, dt);
+
+    if (!ema->valid) {
+        ema->valid = true;
+        ema->value = lux;
+    } else {
+        ema->value += REAL_MUL(lux - ema->value, factor);
+    }
+
+    return ema->value;
+}
+
+/**
+ * Check if brightening input is far enough above the output, and held
+ * steady long enough, to skip the usual settle time.
+ */
+static bool fast_confirmed(struct lightsensor_filter_stage_s *stage,
+                           uint32_t dt, real_t lux)
+{
+    const struct lightsensor_filter_config_s *config = &stage->config;
+    struct lightsensor_hysteresis_s *state = &stage->state.hysteresis;
+
+    /* Divide rather than multiply the output, Q16 overflows otherwise. */
+    if (config->hysteresis.fast <= 0 ||
+        REAL_DIV(lux - state->output, config->hysteresis.fast) <=
+            state->output) {
+        state->fast_lux = 0;
+        return false;
+    }
+
+    /* The window starts over on a sample away from its first one. */
+    if (state->fast_lux == 0 ||
+        REAL_ABS(lux - state->fast_lux) >
+            REAL_MUL(state->fast_lux, config->hysteresis.jitter)) {
+        state->fast_lux = lux;
+        state->fast_time = 0;
+        return false;
+    }
+
+    state->fast_time += dt;
+    return state->fast_time >= config->hysteresis.fast_time * 1000;
+}
+
+static bool hysteresis_update(struct lightsensor_filter_stage_s *stage,
+                              uint32_t dt, real_t *lux)
+{
+    const struct lightsensor_filter_config_s *config = &stage->config;
+    struct lightsensor_hysteresis_s *state = &stage->state.hysteresis;
+    real_t factor = ema_factor(config->hysteresis.tau, dt);
+    bool brighten = *lux > state->output;
+    real_t threshold;
+    uint32_t time;
+
+    threshold = brighten ? config->hysteresis.brighten
+                         : config->hysteresis.darken;
+
+    /* Check if input is steady. */
+    if (REAL_ABS(*lux - state->output) >
+        REAL_MUL(state->output, threshold)) {
+        /* Restart when the change turns around. */
+        if (brighten != state->brighten) {
+            state->brighten = brighten;
+            state->dramatic_time = 0;
+        }
+
+        time = brighten ? config->hysteresis.brighten_time
+                        : config->hysteresis.darken_time;
+        state->steady_time = 0;
+        state->filtered = *lux;
+        state->dramatic_time += dt;
+        state->fast = fast_confirmed(stage, dt, *lux);
+        if (state->dramatic_time < time * 1000 && !state->fast) {
+            /* Not dramatic enough */
+            return false;
+        }
+
+        state->fast_lux = 0;
+    } else {
+        state->dramatic_time = 0;
+        state->fast_lux = 0;
+        state->fast = false;
+        state->filtered = REAL_MUL(*lux, factor) +
+                          REAL_MUL(state->filtered, REAL(1) - factor);
+        if (REAL_ABS(*lux - state->filtered) >
+            REAL_MUL(state->filtered, config->hysteresis.jitter)) {
+            /* Ignore non-stable results */
+            state->steady_time = 0;
+            return false;
+        }
+
+        time = state->filtered > state->output
+                   ? config->hysteresis.brighten_time
+                   : config->hysteresis.darken_time;
+        state->steady_time += dt;
+        if (state->steady_time < time * 1000) {
+            /* Not stable enough. */
+            return false;
+        }
+
+        /* Clear for next detection. */
+        state->steady_time = 0;
+    }
+
+    state->output = state->filtered;
+    *lux = state->output;
+    return true;
+}
+
+static bool outlier_update(struct lightsensor_filter_stage_s *stage,
+                           uint32_t dt, real_t lux)
+{
+    struct lightsensor_outlier_s *outlier = &stage->state.outlier;
+
+    if (outlier->valid && REAL_ABS(lux - outlier->last) >
+                              REAL_MUL(outlier->last,
+                                       stage->config.outlier.ratio)) {
+        outlier->rejected_time += dt;
+        if (outlier->rejected_time < stage->config.outlier.time * 1000) {
+            return false;
+        }
+    }
+
+    outlier->rejected_time = 0;
+    outlier->last = lux;
+    outlier->valid = true;
+    return true;
+}
+
+/* Time the sample accounts for, in us */
+static uint32_t sample_dt(struct lightsensor_filter_s *filter,
+                          uint64_t timestamp)
+{
+    uint64_t last = filter->timestamp;
+
+    filter->timestamp = timestamp;
+    if (timestamp <= last) {
+        return 0;
+    }
+
+    if (last == 0 ||
+        timestamp - last > MAX(LIGHTSENSOR_FILTER_GAP, 2 * filter->period)) {
+        return filter->period;
+    }
+
+    return timestamp - last;
+}
+
+static bool stage_valid(const struct lightsensor_filter_config_s *config)
+{
+    switch (config->type) {
+    case LIGHTSENSOR_FILTER_MEDIAN:
+        return config->median.window > 0 &&
+               config->median.window <= LIGHTSENSOR_MEDIAN_WINDOW_MAX;
+
+    case LIGHTSENSOR_FILTER_EMA:
+        return true;
+
+    case LIGHTSENSOR_FILTER_HYSTERESIS:
+        return config->hysteresis.jitter >= 0 &&
+               config->hysteresis.brighten >= 0 &&
+               config->hysteresis.darken >= 0 &&
+               config->hysteresis.fast >= 0 &&
+               config->hysteresis.brighten_time <= UINT32_MAX / 1000 &&
+               config->hysteresis.darken_time <= UINT32_MAX / 1000 &&
+               config->hysteresis.fast_time <= UINT32_MAX / 1000;
+
+    case LIGHTSENSOR_FILTER_OUTLIER:
+        return config->outlier.ratio >= 0 &&
+               config->outlier.time <= UINT32_MAX / 1000;
+
+    default:
+        return false;
+    }
+}
+
 static void poll_close_cb(uv_handle_t *handle)
 {
     /**/
     free(handle);
 }
 
+static int subscribe(struct lightsensor_s *sensor)
+{
+    uv_topic_t *topic;
+    int ret;
+
+    topic = calloc(1, sizeof(*topic));
+    if (topic == NULL) {
+        err("Failed to allocate memory for sensor topic\n");
+        return -ENOMEM;
+    }
+
+    ret = uv_topic_subscribe(sensor->loop, topic, sensor->meta,
+                             lightsensor_topic_cb);
+    if (ret < 0) {
+        err("Failed to subscribe to sensor topic: %d\n", ret);
+        free(topic);
+        return ret;
+    }
+
+    uv_topic_set_frequency(topic, sensor->frequency);
+
+    topic->flags = (uintptr_t)sensor;
+    sensor->topic = topic;
+    return OK;
+}
+
+/* The sensor stops once its last subscriber is gone. */
+static void unsubscribe(struct lightsensor_s *sensor)
+{
+    if (sensor->topic == NULL) {
+        return;
+    }
+
+    uv_topic_unsubscribe(sensor->topic);
+    uv_close((uv_handle_t *)sensor->topic, poll_close_cb);
+    sensor->topic = NULL;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -76,7 +344,6 @@ struct lightsensor_s *lightsensor_open_device(
     void *user_data)
 {
     struct lightsensor_s *handle;
-    int ret;
 
     if (loop == NULL) {
         return NULL;
@@ -88,19 +355,17 @@ struct lightsensor_s *lightsensor_open_device(
         return NULL;
     }
 
-    ret =
-        uv_topic_subscribe(loop, &handle->topic, sensor, lightsensor_topic_cb);
-    if (ret < 0) {
-        err("Failed to subscribe to sensor topic: %d\n", ret);
+    handle->loop = loop;
+    handle->meta = sensor;
+    handle->frequency = CONFIG_LIGHTSENSOR_FREQUENCY;
+    handle->update_cb = update_cb;
+    handle->user_data = user_data;
+
+    if (subscribe(handle) < 0) {
         free(handle);
         return NULL;
     }
 
-    uv_topic_set_frequency(&handle->topic, CONFIG_LIGHTSENSOR_FREQUENCY);
-
-    handle->topic.flags = (uintptr_t)handle;
-    handle->update_cb = update_cb;
-    handle->user_data = user_data;
     return handle;
 }
 
@@ -111,6 +376,194 @@ void lightsensor_close_device(struct lightsensor_s *sensor)
         return;
     }
 
-    uv_topic_unsubscribe(&sensor->topic);
-    uv_close((uv_handle_t *)&sensor->topic, poll_close_cb);
+    unsubscribe(sensor);
+    free(sensor);
+}
+
+int lightsensor_pause(struct lightsensor_s *sensor)
+{
+    if (sensor->topic == NULL) {
+        return OK;
+    }
+
+    info("pause sensor\n");
+    unsubscribe(sensor);
+    return OK;
+}
+
+int lightsensor_resume(struct lightsensor_s *sensor)
+{
+    if (sensor->topic != NULL) {
+        return OK;
+    }
+
+    info("resume sensor\n");
+    return subscribe(sensor);
+}
+
+int lightsensor_set_frequency(struct lightsensor_s *sensor,
+                              unsigned int frequency)
+{
+    int ret;
+
+    if (frequency == 0) {
+        return -EINVAL;
+    }
+
+    if (frequency == sensor->frequency) {
+        return OK;
+    }
+
+    /* A paused sensor takes the new rate when it resumes. */
+    if (sensor->topic != NULL) {
+        ret = uv_topic_set_frequency(sensor->topic, frequency);
+        if (ret < 0) {
+            err("Failed to set sensor frequency %u: %d\n", frequency, ret);
+            return ret;
+        }
+    }
+
+    info("sensor frequency: %u -> %u\n", sensor->frequency, frequency);
+    sensor->frequency = frequency;
+    return OK;
+}
+
+unsigned int lightsensor_get_frequency(struct lightsensor_s *sensor)
+{
+    return sensor->frequency;
+}
+
+int lightsensor_filter_init(struct lightsensor_filter_s *filter,
+                            const struct lightsensor_filter_config_s stages[],
+                            int n)
+{
+    int i;
+
+    if (n < 0 || n > LIGHTSENSOR_FILTER_STAGES_MAX) {
+        err("Invalid number of filter stages: %d\n", n);
+        return -EINVAL;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!stage_valid(&stages[i])) {
+            err("Invalid filter stage %d, type %d\n", i, stages[i].type);
+            return -EINVAL;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        filter->stages[i].config = stages[i];
+    }
+
+    filter->nstages = n;
+    lightsensor_filter_set_frequency(filter, CONFIG_LIGHTSENSOR_FREQUENCY);
+    lightsensor_filter_reset(filter);
+    return OK;
+}
+
+void lightsensor_filter_set_frequency(struct lightsensor_filter_s *filter,
+                                      unsigned int frequency)
+{
+    filter->period = 1000000 / MAX(frequency, 1);
+}
+
+void lightsensor_filter_reset(struct lightsensor_filter_s *filter)
+{
+    struct lightsensor_filter_stage_s *stage;
+
+    for (int i = 0; i < filter->nstages; i++) {
+        stage = &filter->stages[i];
+        memset(&stage->state, 0, sizeof(stage->state));
+    }
+
+    filter->timestamp = 0;
+}
+
+void lightsensor_filter_seed(struct lightsensor_filter_s *filter,
+                             uint64_t timestamp, real_t lux)
+{
+    struct lightsensor_filter_stage_s *stage;
+    int i;
+
+    lightsensor_filter_reset(filter);
+
+    for (int n = 0; n < filter->nstages; n++) {
+        stage = &filter->stages[n];
+
+        switch (stage->config.type) {
+        case LIGHTSENSOR_FILTER_MEDIAN:
+            for (i = 0; i < stage->config.median.window; i++) {
+                stage->state.median.ring[i] = lux;
+                stage->state.median.sorted[i] = lux;
+            }
+
+            stage->state.median.n = stage->config.median.window;
+            break;
+
+        case LIGHTSENSOR_FILTER_EMA:
+            stage->state.ema.value = lux;
+            stage->state.ema.valid = true;
+            break;
+
+        case LIGHTSENSOR_FILTER_HYSTERESIS:
+            stage->state.hysteresis.output = lux;
+            stage->state.hysteresis.filtered = lux;
+            break;
+
+        case LIGHTSENSOR_FILTER_OUTLIER:
+            stage->state.outlier.last = lux;
+            stage->state.outlier.valid = true;
+            break;
+        }
+    }
+
+    filter->timestamp = timestamp;
+}
+
+bool lightsensor_filter_update(struct lightsensor_filter_s *filter,
+                               uint64_t timestamp, real_t *lux)
+{
+    struct lightsensor_filter_stage_s *stage;
+    uint32_t dt;
+
+    filter->fast = false;
+
+#ifndef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    /* NaN would never leave a median window, Q16 lux is always finite. */
+    if (!isfinite(*lux)) {
+        return false;
+    }
+#endif
+
+    dt = sample_dt(filter, timestamp);
+
+    for (int i = 0; i < filter->nstages; i++) {
+        stage = &filter->stages[i];
+
+        switch (stage->config.type) {
+        case LIGHTSENSOR_FILTER_MEDIAN:
+            *lux = median_update(stage, *lux);
+            break;
+
+        case LIGHTSENSOR_FILTER_EMA:
+            *lux = ema_update(stage, dt, *lux);
+            break;
+
+        case LIGHTSENSOR_FILTER_HYSTERESIS:
+            if (!hysteresis_update(stage, dt, lux)) {
+                return false;
+            }
+
+            filter->fast = stage->state.hysteresis.fast;
+            break;
+
+        case LIGHTSENSOR_FILTER_OUTLIER:
+            if (!outlier_update(stage, dt, *lux)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    return true;
 }
@@ -25,23 +25,135 @@
  * Included Files
  ****************************************************************************/
 
+#include <stdbool.h>
+
 #include <uv.h>
 #include <uv_ext.h>
 
 #include <uORB/uORB.h>
 #include <sensor/light.h>
 
+#include "fixedpoint.h"
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 #define LIGHTSENSOR_TOPIC_DEFAULT ORB_ID(sensor_light)
 
+#define LIGHTSENSOR_FILTER_STAGES_MAX 4   /* Stages in a filter chain */
+#define LIGHTSENSOR_MEDIAN_WINDOW_MAX 15  /* Samples of a median stage */
+#define LIGHTSENSOR_FILTER_GAP 1000000    /* Samples further apart restart */
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
 struct lightsensor_s;
 
+enum lightsensor_filter_type_e {
+    /* Median of the last 'window' samples, removes spikes. */
+    LIGHTSENSOR_FILTER_MEDIAN,
+
+    /* Exponential moving average with time constant 'tau',
+     * y += dt / (tau + dt) * (x - y). */
+    LIGHTSENSOR_FILTER_EMA,
+
+    /**
+     * Hold the output until the input settles. A new output is the input
+     * smoothed with time constant 'tau' once it stays within 'jitter' of
+     * the smoothed value, or the latest input once it stays beyond
+     * 'brighten' above or 'darken' below the output. Input must settle for
+     * 'brighten_time' to raise the output and 'darken_time' to lower it.
+     * Input more than 'fast' above the output that holds within 'jitter'
+     * for 'fast_time' raises it at once, 'fast' 0 disables this path.
+     */
+    LIGHTSENSOR_FILTER_HYSTERESIS,
+
+    /* Drop samples beyond 'ratio' of the last one, unless they keep coming
+     * for 'time', which is a real change. */
+    LIGHTSENSOR_FILTER_OUTLIER,
+};
+
+/**
+ * One stage of a filter chain. Ratios are relative to the lux value, e.g.
+ * 0.2 for 20%. Times are in ms and measured with sample timestamps, so
+ * they hold at any sample rate. A sample accounts for the time since the
+ * previous one. The first one, and one after a gap longer than
+ * LIGHTSENSOR_FILTER_GAP or two sample periods such as a pause, account
+ * for one sample period, see lightsensor_filter_set_frequency().
+ */
+struct lightsensor_filter_config_s {
+    enum lightsensor_filter_type_e type;
+    union {
+        struct {
+            int window;
+        } median;
+
+        struct {
+            uint32_t tau;
+        } ema;
+
+        struct {
+            uint32_t tau;
+            real_t jitter;
+            real_t brighten;
+            real_t darken;
+            uint32_t brighten_time;
+            uint32_t darken_time;
+            real_t fast;
+            uint32_t fast_time;
+        } hysteresis;
+
+        struct {
+            real_t ratio;
+            uint32_t time;
+        } outlier;
+    };
+};
+
+struct lightsensor_filter_stage_s {
+    struct lightsensor_filter_config_s config;
+    union {
+        struct lightsensor_median_s {
+            real_t ring[LIGHTSENSOR_MEDIAN_WINDOW_MAX];
+            real_t sorted[LIGHTSENSOR_MEDIAN_WINDOW_MAX];
+            int pos;
+            int n;
+        } median;
+
+        struct lightsensor_ema_s {
+            real_t value;
+            bool valid;
+        } ema;
+
+        struct lightsensor_hysteresis_s {
+            real_t output;
+            real_t filtered;
+            uint32_t steady_time;   /* in us */
+            uint32_t dramatic_time; /* in us */
+            bool brighten;          /* Direction of the dramatic change */
+            real_t fast_lux;        /* First lux of the fast window, or 0 */
+            uint32_t fast_time;     /* in us */
+            bool fast;              /* Output took the fast path */
+        } hysteresis;
+
+        struct lightsensor_outlier_s {
+            real_t last;
+            uint32_t rejected_time; /* in us */
+            bool valid;
+        } outlier;
+    } state;
+};
+
+/* Filter chain, state is fixed-size and nothing is allocated per sample. */
+struct lightsensor_filter_s {
+    struct lightsensor_filter_stage_s stages[LIGHTSENSOR_FILTER_STAGES_MAX];
+    int nstages;
+    uint64_t timestamp; /* Last sample, 0 if none */
+    uint32_t period;    /* Nominal sample period in us */
+    bool fast;          /* Last output took the fast path */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -53,4 +165,75 @@ struct lightsensor_s *lightsensor_open_device(
 
 void lightsensor_close_device(struct lightsensor_s *sensor);
 
+/**
+ * @brief Drop the sensor subscription, so the sensor can stop sampling
+ * @param sensor The sensor
+ * @return OK
+ */
+int lightsensor_pause(struct lightsensor_s *sensor);
+
+/**
+ * @brief Subscribe again after lightsensor_pause(), at the last set rate
+ * @param sensor The sensor
+ * @return OK, or a negated errno of the topic
+ */
+int lightsensor_resume(struct lightsensor_s *sensor);
+
+/**
+ * @brief Change the sample rate, the subscription is kept
+ * @param sensor The sensor
+ * @param frequency Sample rate in Hz
+ * @return OK, or a negated errno of the topic
+ */
+int lightsensor_set_frequency(struct lightsensor_s *sensor,
+                              unsigned int frequency);
+unsigned int lightsensor_get_frequency(struct lightsensor_s *sensor);
+
+/**
+ * @brief Set up a filter chain, samples go through stages in order
+ * @param filter Filter to initialize
+ * @param stages Stage configurations, copied
+ * @param n Number of stages, up to LIGHTSENSOR_FILTER_STAGES_MAX
+ * @return OK, or -EINVAL if a stage is invalid
+ */
+int lightsensor_filter_init(struct lightsensor_filter_s *filter,
+                            const struct lightsensor_filter_config_s stages[],
+                            int n);
+
+/**
+ * @brief Set the sample rate the filter expects, CONFIG_LIGHTSENSOR_FREQUENCY
+ *        after lightsensor_filter_init()
+ * @param filter The filter
+ * @param frequency Sample rate in Hz
+ */
+void lightsensor_filter_set_frequency(struct lightsensor_filter_s *filter,
+                                      unsigned int frequency);
+
+/**
+ * @brief Clear the history of all stages, keeping their configuration
+ * @param filter The filter
+ */
+void lightsensor_filter_reset(struct lightsensor_filter_s *filter);
+
+/**
+ * @brief Restart the filter as if 'lux' had been steady up to 'timestamp',
+ *        the following samples are filtered against it
+ * @param filter The filter
+ * @param timestamp Sample timestamp in us
+ * @param lux Lux to start from
+ */
+void lightsensor_filter_seed(struct lightsensor_filter_s *filter,
+                             uint64_t timestamp, real_t lux);
+
+/**
+ * @brief Run a sample through the filter chain
+ * @param filter The filter
+ * @param timestamp Sample timestamp in us
+ * @param lux Sample, replaced by the filter output
+ * @return True if there is an output, false if a stage held the sample or
+ *         the sample is not a finite number
+ */
+bool lightsensor_filter_update(struct lightsensor_filter_s *filter,
+                               uint64_t timestamp, real_t *lux);
+
 #endif
@@ -84,10 +84,20 @@ static void set_target(struct brightness_s *controller, int target, int ramp)
     if (controller->display == NULL)
         return;
 
-    if (controller->abc) {
-        abc_set_target(controller->abc, target, ramp);
+    if (controller->abc == NULL ||
+        controller->current_mode != BRIGHTNESS_MODE_AUTO) {
+        display_brightness_set(controller->display, target, ramp,
+                               DISPLAY_RAMP_LINEAR);
+    } else if (target == BRIGHTNESS_LEVEL_OFF) {
+        /* Nothing to follow with the panel off, stop the sensor. */
+        abc_pause(controller->abc, ABC_PAUSE_DISPLAY_OFF);
+        display_brightness_set(controller->display, target, ramp,
+                               DISPLAY_RAMP_LINEAR);
+    } else if (abc_get_paused(controller->abc) & ABC_PAUSE_DISPLAY_OFF) {
+        /* Panel is back on, auto brightness picks the level. */
+        abc_resume(controller->abc, ABC_PAUSE_DISPLAY_OFF);
     } else {
-        display_brightness_set(controller->display, target, ramp);
+        abc_set_target(controller->abc, target, ramp);
     }
 }
 
@@ -108,14 +118,25 @@ static void apply_session(brightness_session_t *pending)
                pending->mode ? "MANUAL" : "AUTO");
         controller->current_mode = pending->mode;
         if (pending->mode == BRIGHTNESS_MODE_MANUAL) {
+            /* Keep abc dormant with its curve and lux history, so going
+             * back to auto mode is cheap and starts from the last lux. */
             if (abc != NULL) {
-                abc_deinit(abc);
-                abc = NULL;
+                abc_pause(abc, ABC_PAUSE_MANUAL);
             }
         } else {
             if (abc == NULL && controller->display) {
                 abc = abc_init(controller->loop, controller->display);
             }
+
+            if (abc != NULL) {
+                if (controller->current_target == BRIGHTNESS_LEVEL_OFF) {
+                    abc_pause(abc, ABC_PAUSE_DISPLAY_OFF);
+                } else {
+                    abc_resume(abc, ABC_PAUSE_DISPLAY_OFF);
+                }
+
+                abc_resume(abc, ABC_PAUSE_MANUAL);
+            }
         }
 
         controller->abc = abc;
@@ -350,3 +371,47 @@ int brightness_get_user_point(brightness_session_t *session, int *lux,
 {
     return brightness_user_point_internal(session, lux, target, false);
 }
+
+int brightness_get_user_points(brightness_session_t *session, int lux[],
+                               int target[], int n)
+{
+    if (session == NULL || n < 0)
+        return -EINVAL;
+
+    if (session->mode != BRIGHTNESS_MODE_AUTO)
+        return -EINVAL;
+
+    if (g_controller->abc == NULL)
+        return -ENOSYS;
+
+    return abc_get_user_points(g_controller->abc, lux, target, n);
+}
+
+int brightness_set_user_points(brightness_session_t *session, const int lux[],
+                               const int target[], int n, int gamma)
+{
+    if (session == NULL || n < 0)
+        return -EINVAL;
+
+    if (session->mode != BRIGHTNESS_MODE_AUTO)
+        return -EINVAL;
+
+    if (g_controller->abc == NULL)
+        return -ENOSYS;
+
+    return abc_set_user_points(g_controller->abc, lux, target, n, gamma);
+}
+
+int brightness_get_user_gamma(brightness_session_t *session)
+{
+    if (session == NULL)
+        return -EINVAL;
+
+    if (session->mode != BRIGHTNESS_MODE_AUTO)
+        return -EINVAL;
+
+    if (g_controller->abc == NULL)
+        return -ENOSYS;
+
+    return abc_get_user_gamma(g_controller->abc);
+}
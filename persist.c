@@ -20,8 +20,11 @@
 
 #include "brightness.h"
 #include <kvdb.h>
+#include <stdio.h>
 #include <sys/types.h>
 
+#include "persist.h"
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
@@ -30,6 +33,53 @@
 #define KEY_BRIGHTNESS_TARGET_LEVEL "persist.brightness.target"
 #define KEY_BRIGHTNESS_USER_LUX "persist.brightness.user_lux"
 #define KEY_BRIGHTNESS_USER_TARGET "persist.brightness.user_target"
+#define KEY_BRIGHTNESS_USER_POINTS "persist.brightness.user_points"
+#define KEY_BRIGHTNESS_USER_GAMMA "persist.brightness.user_gamma"
+
+#define USER_POINTS_MAX CONFIG_BRIGHTNESS_USER_POINTS
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Points go as "lux:target,lux:target", oldest first. */
+static int format_user_points(char *buf, size_t size, const int lux[],
+                              const int target[], int n)
+{
+    size_t len = 0;
+    int ret;
+    int i;
+
+    buf[0] = '\0';
+    for (i = 0; i < n; i++) {
+        ret = snprintf(buf + len, size - len, "%s%d:%d", i ? "," : "",
+                       lux[i], target[i]);
+        if (ret < 0 || (size_t)ret >= size - len) {
+            return ERROR;
+        }
+
+        len += ret;
+    }
+
+    return OK;
+}
+
+static int parse_user_points(const char *buf, int lux[], int target[], int n)
+{
+    int count = 0;
+    int len;
+
+    while (count < n && sscanf(buf, "%d:%d%n", &lux[count], &target[count],
+                               &len) == 2) {
+        count++;
+        buf += len;
+        if (*buf++ != ',') {
+            break;
+        }
+    }
+
+    return count;
+}
 
 /****************************************************************************
  * Public Functions
@@ -40,19 +90,25 @@ int brightness_save_settings(void)
     int ret;
     int mode;
     int target;
-    int user_lux = 1;
-    int user_target = 1; /* The extra user control point for auto brightness. */
+    int n;
+    int gamma;
+    int user_lux[USER_POINTS_MAX];
+    int user_target[USER_POINTS_MAX]; /* Learned auto brightness points */
 
     brightness_session_t *session = brightness_get_system_session();
 
     mode = brightness_get_mode(session);
     target = brightness_get_target(session);
-    brightness_get_user_point(session, &user_lux, &user_target);
+    n = brightness_get_user_points(session, user_lux, user_target,
+                                   USER_POINTS_MAX);
+    gamma = brightness_get_user_gamma(session);
 
     ret = property_set_int32(KEY_BRIGHTNESS_MODE, mode);
     ret |= property_set_int32(KEY_BRIGHTNESS_TARGET_LEVEL, target);
-    ret |= property_set_int32(KEY_BRIGHTNESS_USER_LUX, user_lux);
-    ret |= property_set_int32(KEY_BRIGHTNESS_USER_TARGET, user_target);
+    if (n >= 0 && gamma > 0) {
+        ret |= brightness_save_user_points(user_lux, user_target, n, gamma);
+    }
+
     if (ret != OK) {
         return ERROR;
     }
@@ -72,15 +128,36 @@ int brightness_save_level(int level)
     return ret == OK ? OK : ERROR;
 }
 
-int brightness_save_user_point(int lux, int target)
+int brightness_save_user_points(const int lux[], const int target[], int n,
+                                int gamma)
 {
+    char buf[PROP_VALUE_MAX];
     int ret;
-    ret = property_set_int32(KEY_BRIGHTNESS_USER_LUX, lux);
-    ret |= property_set_int32(KEY_BRIGHTNESS_USER_TARGET, target);
+
+    ret = format_user_points(buf, sizeof(buf), lux, target, n);
+    if (ret == OK) {
+        ret = property_set_int32(KEY_BRIGHTNESS_USER_GAMMA, gamma);
+        ret |= property_set(KEY_BRIGHTNESS_USER_POINTS, buf);
+    }
 
     return ret == OK ? OK : ERROR;
 }
 
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+int brightness_test_format_user_points(char *buf, size_t size,
+                                       const int lux[], const int target[],
+                                       int n)
+{
+    return format_user_points(buf, size, lux, target, n);
+}
+
+int brightness_test_parse_user_points(const char *buf, int lux[],
+                                      int target[], int n)
+{
+    return parse_user_points(buf, lux, target, n);
+}
+#endif
+
 int brightness_restore_settings(void)
 {
     brightness_session_t *session = brightness_get_system_session();
@@ -88,13 +165,29 @@ int brightness_restore_settings(void)
     int target =
         property_get_int32(KEY_BRIGHTNESS_TARGET_LEVEL,
                            (BACKLIGHT_LEVEL_MAX + BACKLIGHT_LEVEL_MIN) / 2);
-    int user_lux = property_get_int32(KEY_BRIGHTNESS_USER_LUX, 1);
-    int user_target = property_get_int32(KEY_BRIGHTNESS_USER_TARGET, 1);
+    int user_lux[USER_POINTS_MAX];
+    int user_target[USER_POINTS_MAX];
+    char buf[PROP_VALUE_MAX];
+    int gamma;
+    int n;
 
     /* Disable auto brightness mode before set new target. */
     brightness_set_mode(session, BRIGHTNESS_MODE_MANUAL);
     brightness_set_target(session, target, 0);
     brightness_set_mode(session, mode);
-    brightness_set_user_point(session, user_lux, user_target);
+
+    if (property_get(KEY_BRIGHTNESS_USER_POINTS, buf, NULL) >= 0) {
+        /* Loaded as saved, so nothing is saved over them meanwhile. */
+        n = parse_user_points(buf, user_lux, user_target, USER_POINTS_MAX);
+        gamma = property_get_int32(KEY_BRIGHTNESS_USER_GAMMA,
+                                   BRIGHTNESS_USER_GAMMA_ONE);
+        brightness_set_user_points(session, user_lux, user_target, n, gamma);
+    } else {
+        /* Settings saved with a single user point, learn it again. */
+        brightness_set_user_point(
+            session, property_get_int32(KEY_BRIGHTNESS_USER_LUX, 1),
+            property_get_int32(KEY_BRIGHTNESS_USER_TARGET, 1));
+    }
+
     return OK;
 }
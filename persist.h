@@ -25,6 +25,8 @@
  * Included Files
  ****************************************************************************/
 
+#include <stddef.h>
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
@@ -40,7 +42,17 @@
 int brightness_save_settings(void);
 int brightness_save_mode(int mode);
 int brightness_save_level(int level);
-int brightness_save_user_point(int lux, int target);
+int brightness_save_user_points(const int lux[], const int target[], int n,
+                                int gamma);
 int brightness_restore_settings(void);
 
+#ifdef CONFIG_BRIGHTNESS_SERVICE_TEST
+/* Test hooks, the user point value without the property store. */
+int brightness_test_format_user_points(char *buf, size_t size,
+                                       const int lux[], const int target[],
+                                       int n);
+int brightness_test_parse_user_points(const char *buf, int lux[],
+                                      int target[], int n);
+#endif
+
 #endif
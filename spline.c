@@ -34,24 +34,74 @@
  * https://android.googlesource.com/platform/frameworks/base/+/master/core/java/android/util/Spline.java
  */
 
+#include <float.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "private.h"
+#include "spline.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
 
-enum spline_type_e {
-    SPLINE_TYPE_MONOTONE_CUBIC = 0,
-    SPLINE_TYPE_LINEAR,
-};
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+/* Range of control points for the fixed-point engine. Tangents times
+ * segment width are up to 6 times the range of y, and the evaluation adds
+ * 3 times y to them, which must all fit in Q16. */
+#define B16_X_MAX 32767.0f
+#define B16_Y_MAX 2048.0f
+#endif
 
-struct spline_s {
-    float *mX;
-    float *mY;
-    float *mM;
-    int n;
-    enum spline_type_e type;
-};
+/* Float rounding of a lookup table interpolation, relative to the values
+ * it interpolates. */
+#define LUT_ROUNDING (16.0f * FLT_EPSILON)
+
+/* Vector engine of spline_interpolate_batch(). ARMv7 NEON has no exact
+ * division, so only AArch64 uses it, other targets run the scalar one. */
+#if defined(__SSE2__)
+#define SPLINE_LANES 4
+#define lanes_t __m128
+#define lanes_load(p) _mm_loadu_ps(p)
+#define lanes_store(p, v) _mm_storeu_ps(p, v)
+#define lanes_dup(a) _mm_set1_ps(a)
+#define lanes_add(a, b) _mm_add_ps(a, b)
+#define lanes_sub(a, b) _mm_sub_ps(a, b)
+#define lanes_mul(a, b) _mm_mul_ps(a, b)
+#define lanes_div(a, b) _mm_div_ps(a, b)
+#define lanes_set(a, b, c, d) _mm_setr_ps(a, b, c, d)
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SPLINE_LANES 4
+#define lanes_t float32x4_t
+#define lanes_load(p) vld1q_f32(p)
+#define lanes_store(p, v) vst1q_f32(p, v)
+#define lanes_dup(a) vdupq_n_f32(a)
+#define lanes_add(a, b) vaddq_f32(a, b)
+#define lanes_sub(a, b) vsubq_f32(a, b)
+#define lanes_mul(a, b) vmulq_f32(a, b)
+#define lanes_div(a, b) vdivq_f32(a, b)
+#define lanes_set(a, b, c, d) ((float32x4_t){a, b, c, d})
+#endif
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
 
 static int is_strictly_increasing(const float *x, int length)
 {
@@ -92,79 +142,138 @@ static int is_monotonic(const float *x, int length)
     return 1; // True
 }
 
-static int monotone_cubic_spline_init(struct spline_s *spline, float *x,
-                                      float *y, int n)
+/* Remember the segment of a lookup. Read-only splines can be constant
+ * data, so they don't keep it and start each lookup from the first one. */
+static int cache_segment(struct spline_s *spline, int i)
 {
-    float *d;
-    float *m;
-    float h;
-    float a;
-    float b;
-
-    if (x == NULL || y == NULL || n < 2) {
-        err("No enough data\n");
-        return ERROR;
+    if (!spline->readonly) {
+        spline->last = i;
     }
 
-    d = malloc((n - 1) * sizeof(float));
-    m = malloc(n * sizeof(float));
+    return i;
+}
 
-    /* Compute slopes of secant lines between successive points. */
-    for (int i = 0; i < n - 1; i++) {
-        h = x[i + 1] - x[i];
-        if (h <= 0.0f) {
-            err("Not strictly increasing value.\n");
-            goto exit_error;
+/**
+ * Find the segment 'i' so that x[i] <= x < x[i + 1], x must be inside the
+ * spline. Lux changes slowly, so the segment of last lookup or its neighbour
+ * is checked before falling back to binary search.
+ */
+static int find_segment(struct spline_s *spline, float x)
+{
+    const struct spline_knot_s *k = spline->knots;
+    int i = spline->last;
+    int lo;
+    int hi;
+    int mid;
+
+    if (x >= k[i].x) {
+        if (x < k[i + 1].x) {
+            return i;
+        }
+
+        if (i + 2 < spline->n && x < k[i + 2].x) {
+            return cache_segment(spline, i + 1);
+        }
+    } else if (i > 0 && x >= k[i - 1].x) {
+        return cache_segment(spline, i - 1);
+    }
+
+    lo = 0;
+    hi = spline->n - 1;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (x >= k[mid].x) {
+            lo = mid;
+        } else {
+            hi = mid;
         }
+    }
 
-        d[i] = (y[i + 1] - y[i]) / h;
+    return cache_segment(spline, lo);
+}
+
+/* Slope of the secant line between knot i and i + 1. */
+static float secant(const struct spline_knot_s *k, int i)
+{
+    return (k[i + 1].y - k[i].y) / (k[i + 1].x - k[i].x);
+}
+
+/* Initial tangent of knot i, the average of the secants around it. */
+static float initial_tangent(const struct spline_knot_s *k, int n, int i)
+{
+    if (i == 0) {
+        return secant(k, 0);
+    } else if (i == n - 1) {
+        return secant(k, n - 2);
     }
 
-    /* Initialize the tangents as the average of the secants. */
-    m[0] = d[0];
-    for (int i = 1; i < n - 1; i++) {
-        m[i] = (d[i - 1] + d[i]) * 0.5f;
+    return (secant(k, i - 1) + secant(k, i)) * 0.5f;
+}
+
+/**
+ * Compute the tangents after knots from 'lo' to 'hi' have been changed.
+ * The monotonicity pass runs from left to right, so it restarts from the
+ * segment left of the changes and stops once a tangent handed over to the
+ * unchanged knots matches the saved one. The result equals a full pass.
+ * @return Index of the last knot whose tangent was recomputed, or ERROR.
+ */
+static int monotone_cubic_spline_update(struct spline_s *spline, int lo,
+                                        int hi)
+{
+    struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    float cur;
+    float next;
+    float d;
+    float h;
+    float a;
+    float b;
+    int i;
+
+    i = MAX(lo - 1, 0);
+    if (i == 0) {
+        k[0].mid = initial_tangent(k, n, 0);
     }
-    m[n - 1] = d[n - 2];
 
     /* Update the tangents to preserve monotonicity. */
-    for (int i = 0; i < n - 1; i++) {
-        if (d[i] == 0.0f) { // successive Y values are equal
-            m[i] = 0.0f;
-            m[i + 1] = 0.0f;
+    for (; i < n - 1; i++) {
+        cur = k[i].mid;
+        next = initial_tangent(k, n, i + 1);
+        d = secant(k, i);
+        if (d == 0.0f) { // successive Y values are equal
+            cur = 0.0f;
+            next = 0.0f;
         } else {
-            a = m[i] / d[i];
-            b = m[i + 1] / d[i];
+            a = cur / d;
+            b = next / d;
             if (a < 0.0f || b < 0.0f) {
                 err("None-monotonic value \n");
-                goto exit_error;
+                return ERROR;
             }
             h = hypotf(a, b);
             if (h > 3.0f) {
                 float t = 3.0f / h;
-                m[i] *= t;
-                m[i + 1] *= t;
+                cur *= t;
+                next *= t;
             }
         }
-    }
 
-    spline->mX = x;
-    spline->mY = y;
-    spline->mM = m;
-    spline->n = n;
-    spline->type = SPLINE_TYPE_MONOTONE_CUBIC;
-    free(d);
-    return OK;
+        k[i].m = cur;
+        if (i + 1 > hi && next == k[i + 1].mid) {
+            /* The rest of the curve is unchanged. */
+            return i;
+        }
 
-exit_error:
-    free(d);
-    free(m);
+        k[i + 1].mid = next;
+    }
 
-    return ERROR;
+    k[n - 1].m = k[n - 1].mid;
+    return n - 1;
 }
 
 float monotone_cubic_spline_interpolate(struct spline_s *spline, float x)
 {
+    const struct spline_knot_s *k = spline->knots;
     int i;
     float h;
     float t;
@@ -173,165 +282,994 @@ float monotone_cubic_spline_interpolate(struct spline_s *spline, float x)
     if (isnan(x)) {
         return x;
     }
-    if (x <= spline->mX[0]) {
-        return spline->mY[0];
+    if (x <= k[0].x) {
+        return k[0].y;
     }
-    if (x >= spline->mX[n - 1]) {
-        return spline->mY[n - 1];
+    if (x >= k[n - 1].x) {
+        return k[n - 1].y;
     }
 
     /* Find the index 'i' of the last point with smaller X. */
     /* We know this will be within the spline due to the boundary tests. */
-    i = 0;
-    while (x >= spline->mX[i + 1]) {
-        i += 1;
-        if (x == spline->mX[i]) {
-            return spline->mY[i];
-        }
+    i = find_segment(spline, x);
+    if (x == k[i].x) {
+        return k[i].y;
     }
 
     /* Perform cubic Hermite spline interpolation. */
-    h = spline->mX[i + 1] - spline->mX[i];
-    t = (x - spline->mX[i]) / h;
+    h = k[i + 1].x - k[i].x;
+    t = (x - k[i].x) / h;
 
-    return (spline->mY[i] * (1 + 2 * t) + h * spline->mM[i] * t) * (1 - t) *
-               (1 - t) +
-           (spline->mY[i + 1] * (3 - 2 * t) + h * spline->mM[i + 1] * (t - 1)) *
-               t * t;
+    return (k[i].y * (1 + 2 * t) + h * k[i].m * t) * (1 - t) * (1 - t) +
+           (k[i + 1].y * (3 - 2 * t) + h * k[i + 1].m * (t - 1)) * t * t;
 }
 
-static int linear_spline_init(struct spline_s *spline, float *x, float *y,
-                              int n)
+/**
+ * Compute slopes of the segments next to knots from 'lo' to 'hi'.
+ * @return Index of the last knot whose slope was recomputed.
+ */
+static int linear_spline_update(struct spline_s *spline, int lo, int hi)
 {
-    float *m;
-    float h;
-
-    if (x == NULL || y == NULL || n < 2) {
-        err("No enough data\n");
-        return ERROR;
-    }
-
-    m = (float *)malloc(n * sizeof(float));
+    struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    int i;
 
     /* Compute slopes of secant lines between successive points. */
-    for (int i = 0; i < n - 1; i++) {
-        h = x[i + 1] - x[i]; /* we have checked h won't be zero. */
-        m[i] = (y[i + 1] - y[i]) / h;
+    for (i = MAX(lo - 1, 0); i <= hi && i < n - 1; i++) {
+        k[i].m = secant(k, i); /* we have checked h won't be zero. */
     }
 
-    spline->mX = x;
-    spline->mY = y;
-    spline->mM = m;
-    spline->n = n;
-    spline->type = SPLINE_TYPE_LINEAR;
-    return OK;
+    k[n - 1].m = 0.0f;
+    return i;
 }
 
 static float linear_spline_interpolate(struct spline_s *spline, float x)
 {
+    const struct spline_knot_s *k = spline->knots;
     int i;
     int n = spline->n;
 
     if (isnan(x)) {
         return x;
     }
-    if (x <= spline->mX[0]) {
-        return spline->mY[0];
+    if (x <= k[0].x) {
+        return k[0].y;
     }
-    if (x >= spline->mX[n - 1]) {
-        return spline->mY[n - 1];
+    if (x >= k[n - 1].x) {
+        return k[n - 1].y;
     }
 
     /* Find the index 'i' of the last point with smaller X. */
     /* We know this will be within the spline due to the boundary tests. */
-    i = 0;
-    while (x >= spline->mX[i + 1]) {
-        i += 1;
-        if (x == spline->mX[i]) {
-            return spline->mY[i];
-        }
+    i = find_segment(spline, x);
+    if (x == k[i].x) {
+        return k[i].y;
     }
 
     /* Perform linear interpolation. */
-    return spline->mY[i] + spline->mM[i] * (x - spline->mX[i]);
+    return k[i].y + k[i].m * (x - k[i].x);
+}
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+static bool b16_fits(float x, float y)
+{
+    return fabsf(x) <= B16_X_MAX && fabsf(y) <= B16_Y_MAX;
+}
+
+/* Convert knots from 'lo' to 'hi' and the segments next to them. */
+static void b16_update(struct spline_s *spline, int lo, int hi)
+{
+    struct spline_knot_s *k = spline->knots;
+    float h;
+
+    for (int i = MAX(lo - 1, 0); i <= hi && i < spline->n; i++) {
+        k[i].bx = ftob16(k[i].x);
+        k[i].by = ftob16(k[i].y);
+        if (i + 1 < spline->n) {
+            h = k[i + 1].x - k[i].x;
+            k[i].bhm0 = ftob16(h * k[i].m);
+            k[i].bhm1 = ftob16(h * k[i + 1].m);
+        }
+    }
+}
+
+/* Same as find_segment() for the fixed-point engine. */
+static int find_segment_b16(struct spline_s *spline, b16_t x)
+{
+    const struct spline_knot_s *k = spline->knots;
+    int i = spline->last;
+    int lo;
+    int hi;
+    int mid;
+
+    if (x >= k[i].bx) {
+        if (x < k[i + 1].bx) {
+            return i;
+        }
+
+        if (i + 2 < spline->n && x < k[i + 2].bx) {
+            return cache_segment(spline, i + 1);
+        }
+    } else if (i > 0 && x >= k[i - 1].bx) {
+        return cache_segment(spline, i - 1);
+    }
+
+    lo = 0;
+    hi = spline->n - 1;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (x >= k[mid].bx) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return cache_segment(spline, lo);
 }
 
-static int spline_init(struct spline_s *spline, float *x, float *y, int n)
+static b16_t monotone_cubic_spline_interpolate_b16(struct spline_s *spline,
+                                                   b16_t x)
 {
+    const struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    b16_t t;
+    b16_t s;
+    b16_t a;
+    b16_t b;
+    int i;
+
+    if (x <= k[0].bx) {
+        return k[0].by;
+    }
+    if (x >= k[n - 1].bx) {
+        return k[n - 1].by;
+    }
+
+    i = find_segment_b16(spline, x);
+    t = b16divb16(x - k[i].bx, k[i + 1].bx - k[i].bx);
+    s = b16ONE - t;
+
+    /* Same cubic Hermite polynomial as the float engine, grouped by t. */
+    a = k[i].by + b16mulb16(2 * k[i].by + k[i].bhm0, t);
+    b = 3 * k[i + 1].by - k[i].bhm1 +
+        b16mulb16(k[i].bhm1 - 2 * k[i + 1].by, t);
+
+    return b16mulb16(b16mulb16(a, s), s) + b16mulb16(b16mulb16(b, t), t);
+}
+
+static b16_t linear_spline_interpolate_b16(struct spline_s *spline, b16_t x)
+{
+    const struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    b16_t t;
+    int i;
+
+    if (x <= k[0].bx) {
+        return k[0].by;
+    }
+    if (x >= k[n - 1].bx) {
+        return k[n - 1].by;
+    }
+
+    i = find_segment_b16(spline, x);
+    t = b16divb16(x - k[i].bx, k[i + 1].bx - k[i].bx);
+    return k[i].by + b16mulb16(k[i + 1].by - k[i].by, t);
+}
+#endif
+
+static int spline_init(struct spline_s *spline, const float *x,
+                       const float *y, int n)
+{
+    for (int i = 0; i < n; i++) {
+        spline->knots[i].x = x[i];
+        spline->knots[i].y = y[i];
+    }
+
+    spline->n = n;
+    spline->last = 0;
+
     if (is_monotonic(x, n)) {
-        return monotone_cubic_spline_init(spline, x, y, n);
+        spline->type = SPLINE_TYPE_MONOTONE_CUBIC;
+        if (monotone_cubic_spline_update(spline, 0, n - 1) < 0) {
+            return ERROR;
+        }
     } else {
-        return linear_spline_init(spline, x, y, n);
+        spline->type = SPLINE_TYPE_LINEAR;
+        linear_spline_update(spline, 0, n - 1);
+    }
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    b16_update(spline, 0, n - 1);
+#endif
+
+    return OK;
+}
+
+static float spline_interpolate_exact(struct spline_s *spline, float x)
+{
+    if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
+        return monotone_cubic_spline_interpolate(spline, x);
+    } else {
+        return linear_spline_interpolate(spline, x);
+    }
+}
+
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+/**
+ * Piecewise linear approximation of log2(x), exact at powers of two.
+ * It only needs the exponent and mantissa of x, so no log is evaluated.
+ * The table starts at a power of two and has a fixed number of entries per
+ * octave, so the slope changes of the approximation fall on table entries.
+ */
+static float lut_log2(float x)
+{
+    int e;
+    float m = frexpf(x, &e); /* x = m * 2^e, m in [0.5, 1) */
+
+    return (e - 1) + (2.0f * m - 1.0f);
+}
+
+static float lut_exp2(float u)
+{
+    float k = floorf(u);
+
+    return ldexpf(1.0f + (u - k), (int)k);
+}
+
+/* Number of table entries needed for control points from x0 to x1. */
+static int lut_entries(float x0, float x1)
+{
+    /* The table is spaced in log domain, lux must be positive. */
+    if (x0 <= 0.0f) {
+        return 0;
     }
+
+    return (int)ceilf((lut_log2(x1) - floorf(lut_log2(x0))) *
+                      CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION) +
+           1;
 }
 
-static void spline_deinit(struct spline_s *spline)
+static float lut_interpolate(struct spline_s *spline, float x)
 {
-    if (spline == NULL)
+    float pos;
+    int i;
+
+    pos = (lut_log2(x) - spline->lut_start) *
+          CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION;
+    i = (int)pos;
+
+    /* Cells around the first and last control point are not smooth. */
+    if (i < spline->lut_first || i >= spline->lut_last) {
+        return spline_interpolate_exact(spline, x);
+    }
+
+    return spline->lut[i] + (spline->lut[i + 1] - spline->lut[i]) * (pos - i);
+}
+
+static float lut_spline_interpolate(struct spline_s *spline, float x)
+{
+    const struct spline_knot_s *k = spline->knots;
+
+    if (isnan(x)) {
+        return x;
+    }
+    if (x <= k[0].x) {
+        return k[0].y;
+    }
+    if (x >= k[spline->n - 1].x) {
+        return k[spline->n - 1].y;
+    }
+
+    return lut_interpolate(spline, x);
+}
+
+/* Recompute table entries from 'first' to 'last'. */
+static void lut_fill(struct spline_s *spline, int first, int last)
+{
+    int resolution = CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION;
+    float x;
+    int i;
+
+    first = MAX(first, 0);
+    last = MIN(last, spline->lut_size - 1);
+    for (i = first; i <= last; i++) {
+        x = lut_exp2(spline->lut_start + (float)i / resolution);
+        spline->lut[i] = spline_interpolate_exact(spline, x);
+    }
+}
+
+/* Second derivative of cubic segment 'i' at t, which goes from 0 to 1
+ * across the segment. */
+static float hermite_curvature(const struct spline_knot_s *k, int i, float t)
+{
+    float h = k[i + 1].x - k[i].x;
+
+    return ((12.0f * t - 6.0f) * (k[i].y - k[i + 1].y) +
+            (6.0f * t - 4.0f) * h * k[i].m +
+            (6.0f * t - 2.0f) * h * k[i + 1].m) /
+           (h * h);
+}
+
+/**
+ * Bound the error of the linear interpolation from 'a' to 'b', which
+ * starts in segment 'i'. Cells don't cross octaves, where lut_log2() is
+ * linear in x, so the table interpolates linearly in x inside a cell.
+ * The error is then at most (b - a)^2 / 8 times the largest second
+ * derivative in the cell. That of a cubic segment is linear, so it is
+ * largest at one end of the part of the segment inside the cell. A linear
+ * spline bends at knots instead, a knot 'x' adds the change of slope times
+ * (x - a) * (b - x) / (b - a).
+ */
+static float lut_cell_error(struct spline_s *spline, int i, float a, float b)
+{
+    const struct spline_knot_s *k = spline->knots;
+    float curvature = 0.0f;
+    float error = 0.0f;
+    float t0;
+    float t1;
+    float h;
+
+    for (; i < spline->n - 1 && k[i].x < b; i++) {
+        if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
+            h = k[i + 1].x - k[i].x;
+            t0 = fmaxf((a - k[i].x) / h, 0.0f);
+            t1 = fminf((b - k[i].x) / h, 1.0f);
+            curvature = fmaxf(curvature, fabsf(hermite_curvature(k, i, t0)));
+            curvature = fmaxf(curvature, fabsf(hermite_curvature(k, i, t1)));
+        } else if (k[i].x > a) {
+            error += fabsf(k[i].m - k[i - 1].m) * (k[i].x - a) * (b - k[i].x) /
+                     (b - a);
+        }
+    }
+
+    return error + curvature * (b - a) * (b - a) / 8.0f;
+}
+
+/* Find the worst case error of the table against the exact spline. */
+static void lut_bound(struct spline_s *spline)
+{
+    int resolution = CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION;
+    const struct spline_knot_s *k = spline->knots;
+    float start = spline->lut_start;
+    float error = 0.0f;
+    float cell;
+    float a;
+    float b;
+    int j = 0;
+
+    for (int i = spline->lut_first; i < spline->lut_last; i++) {
+        a = lut_exp2(start + (float)i / resolution);
+        b = lut_exp2(start + (float)(i + 1) / resolution);
+        while (j < spline->n - 2 && k[j + 1].x <= a) {
+            j++;
+        }
+
+        /* Add rounding of the table entries and of the interpolation. */
+        cell = lut_cell_error(spline, j, a, b) +
+               LUT_ROUNDING *
+                   fmaxf(fabsf(spline->lut[i]), fabsf(spline->lut[i + 1]));
+        error = fmaxf(error, cell);
+    }
+
+    spline->lut_error = error;
+}
+
+/* Build the whole table for current control points if it fits. */
+static void lut_init(struct spline_s *spline)
+{
+    int resolution = CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION;
+    float x0 = spline->knots[0].x;
+    float x1 = spline->knots[spline->n - 1].x;
+    float start;
+    int size;
+
+    size = lut_entries(x0, x1);
+    if (size <= 0 || size > spline->lut_capacity) {
+        spline->lut = NULL;
         return;
+    }
 
-    if (spline->mX)
-        free(spline->mX);
-    if (spline->mY)
-        free(spline->mY);
-    if (spline->mM)
-        free(spline->mM);
+    start = floorf(lut_log2(x0));
+    spline->lut = spline->lut_storage;
+    spline->lut_size = size;
+    spline->lut_start = start;
+    spline->lut_first = (int)ceilf((lut_log2(x0) - start) * resolution);
+    spline->lut_last = (int)floorf((lut_log2(x1) - start) * resolution);
+    lut_fill(spline, 0, size - 1);
+    lut_bound(spline);
 
-    spline->mX = NULL;
-    spline->mY = NULL;
-    spline->mM = NULL;
+    info("lookup table: %d entries, max error %.3f\n", size, spline->lut_error);
 }
 
-struct spline_s *spline_create(const float *x, const float *y, int n)
+/* Refresh the table after knots from 'lo' to 'hi' have been changed. */
+static void lut_update(struct spline_s *spline, int lo, int hi, bool ends)
+{
+    const struct spline_knot_s *k = spline->knots;
+    float x0;
+    float x1;
+
+    if (ends || spline->lut == NULL) {
+        lut_init(spline);
+        return;
+    }
+
+    /* Segments next to the changed knots have changed. */
+    x0 = k[MAX(lo - 1, 0)].x;
+    x1 = k[MIN(hi + 1, spline->n - 1)].x;
+    lut_fill(spline,
+             (int)floorf((lut_log2(x0) - spline->lut_start) *
+                         CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION),
+             (int)ceilf((lut_log2(x1) - spline->lut_start) *
+                        CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION));
+    lut_bound(spline);
+}
+#endif
+
+#ifdef SPLINE_LANES
+/**
+ * Gather x, y and m of knot 'i[j]' + 'next' into lane j. The first four
+ * fields of a knot are adjacent, so each knot is loaded as one vector and
+ * the four are transposed.
+ */
+static void lanes_knots(const struct spline_knot_s *k, const int *i, int next,
+                        lanes_t *x, lanes_t *y, lanes_t *m)
+{
+#if defined(__SSE2__)
+    __m128 r0 = _mm_loadu_ps(&k[i[0] + next].x);
+    __m128 r1 = _mm_loadu_ps(&k[i[1] + next].x);
+    __m128 r2 = _mm_loadu_ps(&k[i[2] + next].x);
+    __m128 r3 = _mm_loadu_ps(&k[i[3] + next].x);
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    *x = r0;
+    *y = r1;
+    *m = r2;
+#else
+    float32x4_t r0 = vld1q_f32(&k[i[0] + next].x);
+    float32x4_t r1 = vld1q_f32(&k[i[1] + next].x);
+    float32x4_t r2 = vld1q_f32(&k[i[2] + next].x);
+    float32x4_t r3 = vld1q_f32(&k[i[3] + next].x);
+    float64x2_t t0 = vreinterpretq_f64_f32(vtrn1q_f32(r0, r1));
+    float64x2_t t1 = vreinterpretq_f64_f32(vtrn2q_f32(r0, r1));
+    float64x2_t t2 = vreinterpretq_f64_f32(vtrn1q_f32(r2, r3));
+    float64x2_t t3 = vreinterpretq_f64_f32(vtrn2q_f32(r2, r3));
+
+    *x = vreinterpretq_f32_f64(vtrn1q_f64(t0, t2));
+    *y = vreinterpretq_f32_f64(vtrn1q_f64(t1, t3));
+    *m = vreinterpretq_f32_f64(vtrn2q_f64(t0, t2));
+#endif
+}
+
+/**
+ * Interpolate SPLINE_LANES values with the scalar engine's operations in
+ * the same order, so the results are identical as long as neither is
+ * contracted to FMA, see Makefile. Lanes the scalar engine handles on its
+ * own, NaN, the clamped ends and the knots, are redone by it.
+ */
+static void lanes_interpolate(struct spline_s *spline, const float *x,
+                              float *y)
+{
+    const struct spline_knot_s *k = spline->knots;
+    float res[SPLINE_LANES];
+    int seg[SPLINE_LANES];
+    int special = 0;
+    lanes_t xv = lanes_load(x);
+    lanes_t x0;
+    lanes_t y0;
+    lanes_t m0;
+    lanes_t x1;
+    lanes_t y1;
+    lanes_t m1;
+    lanes_t h;
+    lanes_t t;
+    lanes_t t2;
+    lanes_t u;
+    lanes_t a;
+    lanes_t b;
+    lanes_t r;
+    int j;
+
+    /* Comparisons with NaN are false, it is special as well. */
+    for (j = 0; j < SPLINE_LANES; j++) {
+        seg[j] = 0;
+        if (x[j] > k[0].x && x[j] < k[spline->n - 1].x) {
+            seg[j] = find_segment(spline, x[j]);
+        }
+
+        if (!(x[j] > k[seg[j]].x && x[j] < k[spline->n - 1].x)) {
+            special |= 1 << j;
+        }
+    }
+
+    lanes_knots(k, seg, 0, &x0, &y0, &m0);
+    if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
+        lanes_knots(k, seg, 1, &x1, &y1, &m1);
+        h = lanes_sub(x1, x0);
+        t = lanes_div(lanes_sub(xv, x0), h);
+        t2 = lanes_mul(lanes_dup(2.0f), t);
+        u = lanes_sub(lanes_dup(1.0f), t);
+        a = lanes_add(lanes_mul(y0, lanes_add(lanes_dup(1.0f), t2)),
+                      lanes_mul(lanes_mul(h, m0), t));
+        b = lanes_add(lanes_mul(y1, lanes_sub(lanes_dup(3.0f), t2)),
+                      lanes_mul(lanes_mul(h, m1),
+                                lanes_sub(t, lanes_dup(1.0f))));
+        r = lanes_add(lanes_mul(lanes_mul(a, u), u),
+                      lanes_mul(lanes_mul(b, t), t));
+    } else {
+        r = lanes_add(y0, lanes_mul(m0, lanes_sub(xv, x0)));
+    }
+
+    if (special == 0) {
+        lanes_store(y, r);
+        return;
+    }
+
+    /* x is read before y[j] is written, so both may be the same array. */
+    lanes_store(res, r);
+    for (j = 0; j < SPLINE_LANES; j++) {
+        y[j] = special & (1 << j) ? spline_interpolate_exact(spline, x[j])
+                                  : res[j];
+    }
+}
+
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+/**
+ * lut_log2() of positive normal floats, from the exponent and mantissa
+ * bits as frexpf() splits them: x = 1.f * 2^(e - 127).
+ */
+static lanes_t lanes_log2(lanes_t x)
+{
+#if defined(__SSE2__)
+    __m128i bits = _mm_castps_si128(x);
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    __m128i f = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)),
+                             _mm_set1_epi32(0x3f800000));
+    __m128 m = _mm_castsi128_ps(f);
+
+    return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_sub_ps(m, _mm_set1_ps(1.0f)));
+#else
+    uint32x4_t bits = vreinterpretq_u32_f32(x);
+    int32x4_t e = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)),
+                            vdupq_n_s32(127));
+    uint32x4_t f = vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x7fffff)),
+                             vdupq_n_u32(0x3f800000));
+    float32x4_t m = vreinterpretq_f32_u32(f);
+
+    return vaddq_f32(vcvtq_f32_s32(e), vsubq_f32(m, vdupq_n_f32(1.0f)));
+#endif
+}
+
+/* lut_spline_interpolate() of SPLINE_LANES values, see lanes_interpolate(). */
+static void lanes_lut_interpolate(struct spline_s *spline, const float *x,
+                                  float *y)
+{
+    const struct spline_knot_s *k = spline->knots;
+    const float *lut = spline->lut;
+    float pos[SPLINE_LANES];
+    float res[SPLINE_LANES];
+    int cell[SPLINE_LANES];
+    int special = 0;
+    lanes_t p;
+    lanes_t lo;
+    lanes_t hi;
+    lanes_t r;
+    int j;
+
+    p = lanes_mul(lanes_sub(lanes_log2(lanes_load(x)),
+                            lanes_dup(spline->lut_start)),
+                  lanes_dup(CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION));
+    lanes_store(pos, p);
+
+    /* Lanes outside the table cells, NaN included, read cell 0 and are
+     * redone by the scalar engine. lanes_log2() needs normal x. */
+    for (j = 0; j < SPLINE_LANES; j++) {
+        cell[j] = -1;
+        if (x[j] > k[0].x && x[j] < k[spline->n - 1].x && x[j] >= FLT_MIN) {
+            cell[j] = (int)pos[j];
+        }
+
+        if (cell[j] < spline->lut_first || cell[j] >= spline->lut_last) {
+            cell[j] = 0;
+            special |= 1 << j;
+        }
+    }
+
+    lo = lanes_set(lut[cell[0]], lut[cell[1]], lut[cell[2]], lut[cell[3]]);
+    hi = lanes_set(lut[cell[0] + 1], lut[cell[1] + 1], lut[cell[2] + 1],
+                   lut[cell[3] + 1]);
+    r = lanes_add(lo, lanes_mul(lanes_sub(hi, lo),
+                                lanes_sub(p, lanes_set(cell[0], cell[1],
+                                                       cell[2], cell[3]))));
+
+    if (special == 0) {
+        lanes_store(y, r);
+        return;
+    }
+
+    lanes_store(res, r);
+    for (j = 0; j < SPLINE_LANES; j++) {
+        y[j] = special & (1 << j) ? lut_spline_interpolate(spline, x[j])
+                                  : res[j];
+    }
+}
+#endif
+#endif
+
+/**
+ * Recompute the curve after knots from 'lo' to 'hi' have been changed.
+ * @param ends True if the first or last control point has moved.
+ */
+static void spline_update(struct spline_s *spline, int lo, int hi, bool ends)
+{
+    if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
+        /* Callers have checked the curve stays monotonic. */
+        hi = monotone_cubic_spline_update(spline, lo, hi);
+    } else {
+        hi = linear_spline_update(spline, lo, hi);
+    }
+
+    spline->last = 0;
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    b16_update(spline, lo - 1, hi);
+#endif
+
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+    lut_update(spline, lo - 1, hi, ends);
+#endif
+}
+
+/* Check that y fits between knots 'left' and 'right' of a cubic spline. */
+static bool keeps_monotonic(struct spline_s *spline, int left, int right,
+                            float y)
 {
-    float *_x;
-    float *_y;
+    const struct spline_knot_s *k = spline->knots;
+
+    if (spline->type != SPLINE_TYPE_MONOTONE_CUBIC) {
+        return true;
+    }
+
+    return (left < 0 || k[left].y <= y) &&
+           (right >= spline->n || y <= k[right].y);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+size_t spline_storage_size(const float *x, int n, int capacity)
+{
+    size_t size = sizeof(struct spline_s) +
+                  MAX(n, capacity) * sizeof(struct spline_knot_s);
+
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+    if (x != NULL && n >= 2) {
+        size += lut_entries(x[0], x[n - 1]) * sizeof(float);
+    }
+#endif
+
+    return size;
+}
+
+struct spline_s *spline_init_storage(void *storage, size_t size,
+                                     const float *x, const float *y, int n,
+                                     int capacity)
+{
+    struct spline_s *spline = storage;
+    size_t knots_size;
     int ret;
+
+    if (is_strictly_increasing(x, n) != 1) {
+        err("Error: x must be strictly increasing\n");
+        return NULL;
+    }
+
+    if (y == NULL) {
+        err("No enough data\n");
+        return NULL;
+    }
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    for (int i = 0; i < n; i++) {
+        if (!b16_fits(x[i], y[i])) {
+            err("Point out of fixed-point range: %d\n", i);
+            return NULL;
+        }
+    }
+#endif
+
+    capacity = MAX(n, capacity);
+    knots_size =
+        sizeof(struct spline_s) + capacity * sizeof(struct spline_knot_s);
+    if (storage == NULL || size < knots_size) {
+        err("Storage too small: %zu\n", size);
+        return NULL;
+    }
+
+    memset(spline, 0, sizeof(struct spline_s));
+    spline->knots = (struct spline_knot_s *)(spline + 1);
+    spline->capacity = capacity;
+
+    /* Whatever storage is left holds the lookup table. */
+    spline->lut_storage = (float *)(spline->knots + capacity);
+    spline->lut_capacity = (size - knots_size) / sizeof(float);
+
+    ret = spline_init(spline, x, y, n);
+    if (ret != OK) {
+        return NULL;
+    }
+
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+    lut_init(spline);
+#endif
+
+    return spline;
+}
+
+struct spline_s *spline_create(const float *x, const float *y, int n)
+{
     struct spline_s *spline;
+    void *storage;
+    size_t size;
 
-    if (!is_strictly_increasing(x, n)) {
+    if (is_strictly_increasing(x, n) != 1) {
         err("Error: x must be strictly increasing\n");
         return NULL;
     }
 
-    _x = malloc(n * sizeof(float));
-    _y = malloc(n * sizeof(float));
-    memcpy(_x, x, n * sizeof(float));
-    memcpy(_y, y, n * sizeof(float));
+    size = spline_storage_size(x, n, n);
+    storage = malloc(size);
+    if (storage == NULL) {
+        err("No memory.\n");
+        return NULL;
+    }
 
-    spline = malloc(sizeof(struct spline_s));
+    spline = spline_init_storage(storage, size, x, y, n, n);
     if (spline == NULL) {
-        err("No memory.\n");
-        free(_x);
-        free(_y);
+        free(storage);
         return NULL;
     }
 
-    ret = spline_init(spline, _x, _y, n);
-    if (ret != OK) {
-        free(_x);
-        free(_y);
-        free(spline);
+    spline->allocated = true;
+    return spline;
+}
+
+struct spline_s *spline_copy(void *storage, size_t size,
+                             const struct spline_s *src)
+{
+    struct spline_s *spline = storage;
+    size_t knots_size;
+
+    knots_size =
+        sizeof(struct spline_s) + src->capacity * sizeof(struct spline_knot_s);
+    if (storage == NULL || size < knots_size) {
+        err("Storage too small: %zu\n", size);
         return NULL;
     }
 
+    /* Lookup position of 'src' is left alone, its owner may be using it. */
+    memset(spline, 0, sizeof(struct spline_s));
+    spline->knots = (struct spline_knot_s *)(spline + 1);
+    spline->n = src->n;
+    spline->capacity = src->capacity;
+    spline->type = src->type;
+    memcpy(spline->knots, src->knots, src->n * sizeof(struct spline_knot_s));
+
+    spline->lut_storage = (float *)(spline->knots + spline->capacity);
+    spline->lut_capacity = (size - knots_size) / sizeof(float);
+    if (src->lut != NULL && src->lut_size <= spline->lut_capacity) {
+        spline->lut = spline->lut_storage;
+        spline->lut_size = src->lut_size;
+        spline->lut_start = src->lut_start;
+        spline->lut_first = src->lut_first;
+        spline->lut_last = src->lut_last;
+        spline->lut_error = src->lut_error;
+        memcpy(spline->lut, src->lut, src->lut_size * sizeof(float));
+    }
+
     return spline;
 }
 
+int spline_insert_point(struct spline_s *spline, float x, float y)
+{
+    struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    int i;
+
+    if (spline->readonly || isnan(x) || isnan(y)) {
+        return ERROR;
+    }
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    if (!b16_fits(x, y)) {
+        return ERROR;
+    }
+#endif
+
+    /* Find the first point not smaller than x. */
+    for (i = 0; i < n && k[i].x < x; i++)
+        ;
+
+    if (i < n && k[i].x == x) {
+        /* Point exists, move it. */
+        return spline_move_point(spline, i, x, y);
+    }
+
+    if (n >= spline->capacity) {
+        err("No room for more points: %d\n", n);
+        return ERROR;
+    }
+
+    if (!keeps_monotonic(spline, i - 1, i, y)) {
+        return ERROR;
+    }
+
+    memmove(k + i + 1, k + i, (n - i) * sizeof(struct spline_knot_s));
+    k[i].x = x;
+    k[i].y = y;
+    spline->n = n + 1;
+
+    /* Both secants around the new point are new. */
+    spline_update(spline, i - 1, i + 1, i == 0 || i == n);
+    return i;
+}
+
+int spline_move_point(struct spline_s *spline, int index, float x, float y)
+{
+    struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+    float old_x;
+    float old_y;
+    bool ends;
+    int ret;
+
+    if (spline->readonly || index < 0 || index >= n || isnan(x) ||
+        isnan(y)) {
+        return ERROR;
+    }
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    if (!b16_fits(x, y)) {
+        return ERROR;
+    }
+#endif
+
+    old_x = k[index].x;
+    old_y = k[index].y;
+
+    /* Point passes one of its neighbours, reinsert it. */
+    if ((index > 0 && x <= k[index - 1].x) ||
+        (index < n - 1 && x >= k[index + 1].x)) {
+        if (spline_remove_point(spline, index) < 0) {
+            return ERROR;
+        }
+
+        ret = spline_insert_point(spline, x, y);
+        if (ret < 0) {
+            spline_insert_point(spline, old_x, old_y);
+        }
+
+        return ret;
+    }
+
+    if (!keeps_monotonic(spline, index - 1, index + 1, y)) {
+        return ERROR;
+    }
+
+    ends = (index == 0 || index == n - 1) && x != old_x;
+    k[index].x = x;
+    k[index].y = y;
+    spline_update(spline, index - 1, index + 1, ends);
+    return index;
+}
+
+int spline_remove_point(struct spline_s *spline, int index)
+{
+    struct spline_knot_s *k = spline->knots;
+    int n = spline->n;
+
+    if (spline->readonly || index < 0 || index >= n || n <= 2) {
+        return ERROR;
+    }
+
+    memmove(k + index, k + index + 1,
+            (n - index - 1) * sizeof(struct spline_knot_s));
+    spline->n = n - 1;
+
+    /* The secant across removed point is new. */
+    spline_update(spline, index - 1, index, index == 0 || index == n - 1);
+    return OK;
+}
+
+int spline_get_point(struct spline_s *spline, int index, float *x, float *y)
+{
+    if (index < 0 || index >= spline->n) {
+        return ERROR;
+    }
+
+    if (x) {
+        *x = spline->knots[index].x;
+    }
+
+    if (y) {
+        *y = spline->knots[index].y;
+    }
+
+    return OK;
+}
+
 float spline_interpolate(struct spline_s *spline, float x)
 {
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+    if (spline->lut) {
+        return lut_spline_interpolate(spline, x);
+    }
+#endif
+
+    return spline_interpolate_exact(spline, x);
+}
+
+void spline_interpolate_batch(struct spline_s *spline, const float *x,
+                              float *y, int n)
+{
+    int i = 0;
+
+    /* Same engines as spline_interpolate(), with the dispatch done once,
+     * whole vectors first and the rest one by one. */
+#if CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION > 0
+    if (spline->lut) {
+#ifdef SPLINE_LANES
+        for (; i + SPLINE_LANES <= n; i += SPLINE_LANES) {
+            lanes_lut_interpolate(spline, x + i, y + i);
+        }
+#endif
+
+        for (; i < n; i++) {
+            y[i] = lut_spline_interpolate(spline, x[i]);
+        }
+
+        return;
+    }
+#endif
+
+#ifdef SPLINE_LANES
+    for (; i + SPLINE_LANES <= n; i += SPLINE_LANES) {
+        lanes_interpolate(spline, x + i, y + i);
+    }
+#endif
+
     if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
-        return monotone_cubic_spline_interpolate(spline, x);
+        for (; i < n; i++) {
+            y[i] = monotone_cubic_spline_interpolate(spline, x[i]);
+        }
     } else {
-        return linear_spline_interpolate(spline, x);
+        for (; i < n; i++) {
+            y[i] = linear_spline_interpolate(spline, x[i]);
+        }
+    }
+}
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+b16_t spline_interpolate_b16(struct spline_s *spline, b16_t x)
+{
+    if (spline->type == SPLINE_TYPE_MONOTONE_CUBIC) {
+        return monotone_cubic_spline_interpolate_b16(spline, x);
+    } else {
+        return linear_spline_interpolate_b16(spline, x);
     }
 }
+#endif
+
+float spline_lut_error(struct spline_s *spline)
+{
+    return spline->lut ? spline->lut_error : 0.0f;
+}
 
 void spline_destroy(struct spline_s *spline)
 {
-    if (spline == NULL)
+    if (spline == NULL || !spline->allocated)
         return;
 
-    spline_deinit(spline);
     free(spline);
 }
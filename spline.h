@@ -23,16 +23,68 @@
 
 #include <nuttx/config.h>
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+#include <fixedmath.h>
+#endif
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
-struct spline_s;
-
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+/* The types are public so that a curve can be built as static data, see
+ * tools/gencurve.py. Use the functions below to access a spline. */
+
+enum spline_type_e {
+    SPLINE_TYPE_MONOTONE_CUBIC = 0,
+    SPLINE_TYPE_LINEAR,
+};
+
+/* A segment is evaluated from two adjacent knots, keep them together. The
+ * batch engine loads x to mid as one vector, keep them first and in order. */
+struct spline_knot_s {
+    float x;
+    float y;
+    float m;   /* Tangent for cubic spline, slope of the segment for linear */
+    float mid; /* Cubic tangent after the left segment's monotonicity pass */
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    /* Segment to the next knot for the fixed-point engine. Tangents are
+     * stored multiplied by segment width, which keeps them small. */
+    b16_t bx;
+    b16_t by;
+    b16_t bhm0; /* h * m of this knot */
+    b16_t bhm1; /* h * m of next knot */
+#endif
+};
+
+struct spline_s {
+    struct spline_knot_s *knots; /* Stored right after this struct */
+    int n;
+    int capacity; /* Number of knots the storage can hold */
+    enum spline_type_e type;
+    int last;       /* Segment found by the last lookup, unless read-only */
+    bool allocated; /* Storage allocated by spline_create() */
+    bool readonly;  /* Constant data, never written, not even by lookups */
+
+    /* Optional lookup table, log-spaced in lux between knots[0].x and
+     * knots[n - 1].x, stored after the knots. */
+    float *lut;
+    float *lut_storage;
+    int lut_capacity;
+    int lut_size;
+    float lut_start; /* log2 of the power of two just below knots[0].x */
+    int lut_first;   /* First cell that starts at or after knots[0].x */
+    int lut_last;    /* Cell that contains knots[n - 1].x */
+    float lut_error; /* Bound of the error against the exact spline */
+};
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -48,6 +100,89 @@ struct spline_s;
  */
 struct spline_s *spline_create(const float *x, const float *y, int n);
 
+/**
+ * @brief Get the storage needed by a spline object
+ * @param x Array of x coordinates
+ * @param n Number of points
+ * @param capacity Number of points the object must be able to hold
+ * @return Size in bytes of the object, its control points and lookup table
+ */
+size_t spline_storage_size(const float *x, int n, int capacity);
+
+/**
+ * @brief Create a spline interpolation object in caller provided storage
+ * @param storage Storage for the object, aligned for a pointer
+ * @param size Size of the storage, see spline_storage_size()
+ * @param x Array of x coordinates
+ * @param y Array of y coordinates
+ * @param n Number of points
+ * @param capacity Number of points the object must be able to hold, so that
+ *      points can be inserted later
+ * @return Pointer to the spline object, which is the storage itself
+ * @note Same as spline_create(). The lookup table is skipped if the storage
+ *      has no room for it. The storage stays owned by caller,
+ *      spline_destroy() does nothing on such object.
+ */
+struct spline_s *spline_init_storage(void *storage, size_t size,
+                                     const float *x, const float *y, int n,
+                                     int capacity);
+
+/**
+ * @brief Copy a spline object into caller provided storage
+ * @param storage Storage for the copy, aligned for a pointer
+ * @param size Size of the storage, see spline_storage_size()
+ * @param src Spline to copy, only read
+ * @return Pointer to the copy, which is the storage itself, NULL if the
+ *      storage can't hold the control points of 'src'
+ * @note The copy can be edited even if 'src' is read-only. The lookup table
+ *      is copied if the storage has room for it.
+ */
+struct spline_s *spline_copy(void *storage, size_t size,
+                             const struct spline_s *src);
+
+/**
+ * @brief Insert a control point, or move the one at the same x
+ * @param spline Pointer to the spline object
+ * @param x X coordinate
+ * @param y Y coordinate
+ * @return Index of the point, negative on error
+ * @note Only tangents of the segments around the point are recomputed, the
+ *      result is the same as creating the spline again. A monotonic curve
+ *      must stay monotonic, otherwise nothing changes and ERROR is returned.
+ *      A read-only spline, built as static data, can't be edited.
+ */
+int spline_insert_point(struct spline_s *spline, float x, float y);
+
+/**
+ * @brief Move a control point
+ * @param spline Pointer to the spline object
+ * @param index Index of the point
+ * @param x New X coordinate
+ * @param y New Y coordinate
+ * @return New index of the point, negative on error
+ * @note Same rules as spline_insert_point().
+ */
+int spline_move_point(struct spline_s *spline, int index, float x, float y);
+
+/**
+ * @brief Remove a control point
+ * @param spline Pointer to the spline object
+ * @param index Index of the point
+ * @return 0 on success, negative on error
+ * @note At least two points are kept.
+ */
+int spline_remove_point(struct spline_s *spline, int index);
+
+/**
+ * @brief Get a control point
+ * @param spline Pointer to the spline object
+ * @param index Index of the point
+ * @param x Pointer to store X coordinate, can be NULL
+ * @param y Pointer to store Y coordinate, can be NULL
+ * @return 0 on success, negative on error
+ */
+int spline_get_point(struct spline_s *spline, int index, float *x, float *y);
+
 /**
  * @brief Interpolate a value
  * @param spline Pointer to the spline object
@@ -56,6 +191,43 @@ struct spline_s *spline_create(const float *x, const float *y, int n);
  */
 float spline_interpolate(struct spline_s *spline, float x);
 
+/**
+ * @brief Interpolate an array of values
+ * @param spline Pointer to the spline object
+ * @param x Array of x coordinates
+ * @param y Array to store the interpolated values
+ * @param n Number of values
+ * @note Results are identical to calling spline_interpolate() for each value,
+ *      x and y may be the same array. With SSE2 or AArch64 NEON, four values
+ *      are evaluated at once. Ascending or slowly changing x, like a curve
+ *      sweep or a sensor trace, is the fastest since the segment lookup is
+ *      cached.
+ */
+void spline_interpolate_batch(struct spline_s *spline, const float *x,
+                              float *y, int n);
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+/**
+ * @brief Interpolate a value with the fixed-point engine
+ * @param spline Pointer to the spline object
+ * @param x X coordinate in Q16
+ * @return Interpolated value in Q16
+ * @note Control points are limited to |x| <= 32767 and |y| <= 2048 when the
+ *      fixed-point engine is enabled. The result is within 0.01 of
+ *      spline_interpolate() for curves of the brightness range.
+ */
+b16_t spline_interpolate_b16(struct spline_s *spline, b16_t x);
+#endif
+
+/**
+ * @brief Get the worst case error of the lookup table
+ * @param spline Pointer to the spline object
+ * @return Bound of the absolute error, derived from the second derivative of
+ *      the spline in each table cell, 0 if the spline is evaluated exactly
+ * @note The table is enabled by CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION.
+ */
+float spline_lut_error(struct spline_s *spline);
+
 /**
  * @brief Destroy a spline interpolation object
  * @param spline Pointer to the spline object
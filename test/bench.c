@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmarks of the brightness control hot paths.
+ *
+ * Each benchmark prints one JSON object per line:
+ * {"name": ..., "iterations": ..., "ns_per_op": ..., "allocs_per_op": ...}
+ * Allocations are the change of allocated heap blocks over the measured
+ * loop, taken from mallinfo(). Blocks freed again within the loop do not
+ * show up, blocks kept by any thread while the loop runs do.
+ */
+
+#include <getopt.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "../abc.h"
+#include "../display.h"
+#include "../private.h"
+#include "../spline.h"
+
+#include "fakesensor.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define BENCH_MIN_TIME_MS 200 /* Default run time of each benchmark */
+#define BENCH_LUX_SAMPLES 1024 /* Must be a power of two */
+
+/* User brightness alternates between these to force a curve change. */
+#define BENCH_USER_TARGET_LOW 64
+#define BENCH_USER_TARGET_HIGH 192
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct bench_ctx_s {
+    struct spline_s *cubic;
+    struct spline_s *linear;
+    float lux[BENCH_LUX_SAMPLES];
+    float result[BENCH_LUX_SAMPLES];
+
+    uv_loop_t loop;
+    struct display_brightness_s *display;
+    struct abc_s *abc;
+};
+
+struct bench_case_s {
+    const char *name;
+    void (*run)(struct bench_ctx_s *ctx, long iterations, int arg);
+    int arg;
+    bool abc; /* Needs the controller */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Same points as the default curve */
+static const float g_curve_lux[] = {
+    1,   2,   3,   5,   10,  20,   50,   100,  200,  300,
+    400, 500, 600, 700, 800, 1000, 1200, 1600, 2200, 3000,
+};
+
+static const float g_curve_power[] = {
+    1,  5,  10, 20, 30, 46,  49,  54,  61,  65,
+    70, 76, 82, 87, 98, 108, 131, 161, 230, 255,
+};
+
+/* Not monotonic, interpolated linearly */
+static const float g_linear_power[] = {
+    1,  5,  10, 20, 30, 46,  49,  54,  61,  65,
+    70, 76, 82, 87, 98, 108, 131, 120, 230, 255,
+};
+
+/* spline_create() only makes cubic splines, the linear one is built from
+ * its knots like tools/gencurve.py does, see bench_init(). */
+static struct spline_knot_s g_linear_knots[nitems(g_curve_lux)];
+static struct spline_s g_linear = {
+    .knots = g_linear_knots,
+    .n = nitems(g_linear_knots),
+    .capacity = nitems(g_linear_knots),
+    .type = SPLINE_TYPE_LINEAR,
+};
+
+/* Keep results alive so that the compiler can't drop the work. */
+static volatile float g_sink;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void bench_spline_create(struct bench_ctx_s *ctx, long iterations,
+                                int arg)
+{
+    struct spline_s *spline;
+
+    for (long i = 0; i < iterations; i++) {
+        spline = spline_create(g_curve_lux, g_curve_power, nitems(g_curve_lux));
+        spline_destroy(spline);
+    }
+}
+
+static void bench_interpolate(struct bench_ctx_s *ctx, long iterations,
+                              int arg)
+{
+    struct spline_s *spline = arg ? ctx->linear : ctx->cubic;
+    float sum = 0;
+
+    for (long i = 0; i < iterations; i++) {
+        sum += spline_interpolate(spline, ctx->lux[i & (BENCH_LUX_SAMPLES - 1)]);
+    }
+
+    g_sink = sum;
+}
+
+static void bench_interpolate_batch(struct bench_ctx_s *ctx, long iterations,
+                                    int arg)
+{
+    struct spline_s *spline = arg ? ctx->linear : ctx->cubic;
+    int n;
+
+    /* One op is one value, like the other interpolation benchmarks. */
+    for (long i = 0; i < iterations; i += n) {
+        n = MIN(iterations - i, BENCH_LUX_SAMPLES);
+        spline_interpolate_batch(spline, ctx->lux, ctx->result, n);
+    }
+
+    g_sink = ctx->result[0];
+}
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+static void bench_interpolate_b16(struct bench_ctx_s *ctx, long iterations,
+                                  int arg)
+{
+    struct spline_s *spline = arg ? ctx->linear : ctx->cubic;
+    b16_t lux[BENCH_LUX_SAMPLES];
+    b16_t sum = 0;
+
+    for (int i = 0; i < BENCH_LUX_SAMPLES; i++) {
+        lux[i] = ftob16(ctx->lux[i]);
+    }
+
+    for (long i = 0; i < iterations; i++) {
+        sum += spline_interpolate_b16(spline, lux[i & (BENCH_LUX_SAMPLES - 1)]);
+    }
+
+    g_sink = b16tof(sum);
+}
+#endif
+
+/* Adjustments of one session, which edit the curve of the last one. */
+static void bench_compute_curve(struct bench_ctx_s *ctx, long iterations,
+                                int arg)
+{
+    for (long i = 0; i < iterations; i++) {
+        abc_test_compute_curve(ctx->abc, arg,
+                               i & 1 ? BENCH_USER_TARGET_HIGH
+                                     : BENCH_USER_TARGET_LOW);
+    }
+}
+
+/* Each adjustment starts a session, gamma changes and the curve is rebuilt */
+static void bench_compute_curve_session(struct bench_ctx_s *ctx,
+                                        long iterations, int arg)
+{
+    for (long i = 0; i < iterations; i++) {
+        abc_test_end_session(ctx->abc);
+        abc_test_compute_curve(ctx->abc, arg,
+                               i & 1 ? BENCH_USER_TARGET_HIGH
+                                     : BENCH_USER_TARGET_LOW);
+    }
+}
+
+static void bench_lightsensor(struct bench_ctx_s *ctx, long iterations,
+                              int arg)
+{
+    struct sensor_light sample;
+    const float *data;
+    int size;
+
+    switch (arg) {
+    case DATA_PATTERN_STABLE:
+        data = fakedata_stable;
+        size = nitems(fakedata_stable);
+        break;
+
+    case DATA_PATTERN_RAPID_CHANGE:
+        data = fakedata_rapid_change;
+        size = nitems(fakedata_rapid_change);
+        break;
+
+    default:
+    case DATA_PATTERN_LOW2HIGH:
+        data = fakedata_low2high;
+        size = nitems(fakedata_low2high);
+        break;
+    }
+
+    memset(&sample, 0, sizeof(sample));
+    for (long i = 0; i < iterations; i++) {
+        sample.timestamp += 1000000 / CONFIG_LIGHTSENSOR_FREQUENCY;
+        sample.light = data[i % size];
+        abc_test_feed(ctx->abc, &sample, 1);
+    }
+}
+
+/* clang-format off */
+static const struct bench_case_s g_benches[] = {
+    {"spline_create", bench_spline_create, 0, false},
+    {"spline_interpolate/cubic", bench_interpolate, 0, false},
+    {"spline_interpolate/linear", bench_interpolate, 1, false},
+    {"spline_interpolate_batch/cubic", bench_interpolate_batch, 0, false},
+    {"spline_interpolate_batch/linear", bench_interpolate_batch, 1, false},
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    {"spline_interpolate_b16/cubic", bench_interpolate_b16, 0, false},
+    {"spline_interpolate_b16/linear", bench_interpolate_b16, 1, false},
+#endif
+    {"compute_spline/lux_2", bench_compute_curve, 2, true},
+    {"compute_spline/lux_300", bench_compute_curve, 300, true},
+    {"compute_spline/lux_2500", bench_compute_curve, 2500, true},
+    {"compute_spline/lux_5000", bench_compute_curve, 5000, true},
+    {"compute_spline/new_session/lux_300", bench_compute_curve_session, 300, true},
+    {"lightsensor_update_cb/stable", bench_lightsensor, DATA_PATTERN_STABLE, true},
+    {"lightsensor_update_cb/rapid_change", bench_lightsensor, DATA_PATTERN_RAPID_CHANGE, true},
+    {"lightsensor_update_cb/low2high", bench_lightsensor, DATA_PATTERN_LOW2HIGH, true},
+};
+/* clang-format on */
+
+/**
+ * Run a benchmark for at least 'min_ms', growing the iteration count until
+ * a run is long enough to be timed reliably.
+ */
+static void bench_run(const struct bench_case_s *bench,
+                      struct bench_ctx_s *ctx, int min_ms)
+{
+    uint64_t min_ns = (uint64_t)min_ms * 1000000;
+    uint64_t elapsed;
+    long allocs;
+    long iterations = 1;
+    long next;
+
+    for (;;) {
+        allocs = mallinfo().aordblks;
+        elapsed = now_ns();
+        bench->run(ctx, iterations, bench->arg);
+        elapsed = now_ns() - elapsed;
+        allocs = mallinfo().aordblks - allocs;
+
+        if (elapsed >= min_ns || iterations >= INT32_MAX) {
+            break;
+        }
+
+        /* Aim a bit past the minimum time, growing at most 100 times. */
+        next = elapsed ? (long)(min_ns * 1.2 * iterations / elapsed)
+                       : iterations * 100;
+        iterations = MAX(iterations + 1, MIN(next, iterations * 100));
+    }
+
+    printf("{\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, "
+           "\"allocs_per_op\": %.3f}\n",
+           bench->name, iterations, (double)elapsed / iterations,
+           (double)allocs / iterations);
+    fflush(stdout);
+}
+
+static int bench_init(struct bench_ctx_s *ctx, bool abc)
+{
+    struct spline_knot_s *k = g_linear_knots;
+    int n = nitems(g_linear_knots);
+    uint32_t seed = 1;
+
+    ctx->cubic =
+        spline_create(g_curve_lux, g_curve_power, nitems(g_curve_lux));
+    if (ctx->cubic == NULL) {
+        fprintf(stderr, "Failed to create splines\n");
+        return ERROR;
+    }
+
+    /* Slope of the segment to the next knot, 0 for the last one. */
+    for (int i = 0; i < n; i++) {
+        k[i].x = g_curve_lux[i];
+        k[i].y = g_linear_power[i];
+        k[i].m = i + 1 < n ? (g_linear_power[i + 1] - g_linear_power[i]) /
+                                 (g_curve_lux[i + 1] - g_curve_lux[i])
+                           : 0.0f;
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+        k[i].bx = ftob16(k[i].x);
+        k[i].by = ftob16(k[i].y);
+#endif
+    }
+
+    ctx->linear = &g_linear;
+
+    /* Lux spread evenly in log scale from 0.5 to 4096, in random order. */
+    for (int i = 0; i < BENCH_LUX_SAMPLES; i++) {
+        seed = seed * 1664525 + 1013904223;
+        ctx->lux[i] = exp2f((seed >> 8) / (float)(1 << 24) * 13.0f - 1.0f);
+    }
+
+    if (!abc) {
+        return OK;
+    }
+
+    /* The loop never runs, so display ramps never write the backlight. */
+    uv_loop_init(&ctx->loop);
+    ctx->display = display_brightness_open_device(
+        CONFIG_BRIGHTNESS_SERVICE_DEFAULT_DEVICE, &ctx->loop);
+    if (ctx->display == NULL) {
+        fprintf(stderr, "Failed to open %s, skip controller benchmarks\n",
+                CONFIG_BRIGHTNESS_SERVICE_DEFAULT_DEVICE);
+        return OK;
+    }
+
+    ctx->abc = abc_init(&ctx->loop, ctx->display);
+    if (ctx->abc == NULL) {
+        fprintf(stderr, "Failed to start controller\n");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+static void bench_deinit(struct bench_ctx_s *ctx)
+{
+    spline_destroy(ctx->cubic);
+
+    if (ctx->display) {
+        abc_deinit(ctx->abc);
+        display_brightness_close_device(ctx->display);
+        uv_run(&ctx->loop, UV_RUN_NOWAIT);
+        uv_loop_close(&ctx->loop);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "brightness_bench - brightness control microbenchmarks.\n\n"
+            "  -t, --time <ms>     Minimum run time of each benchmark, "
+            "default %d\n"
+            "  -f, --filter <str>  Only run benchmarks whose name contains "
+            "str\n"
+            "  -l, --list          List benchmarks\n",
+            BENCH_MIN_TIME_MS);
+}
+
+/* clang-format off */
+static const struct option options[] = {
+    {"time", required_argument, NULL, 't'},
+    {"filter", required_argument, NULL, 'f'},
+    {"list", no_argument, NULL, 'l'},
+    {"help", no_argument, NULL, 'h'},
+
+    {NULL},
+};
+/* clang-format on */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    struct bench_ctx_s *ctx;
+    const char *filter = NULL;
+    int min_ms = BENCH_MIN_TIME_MS;
+    bool abc = false;
+    bool list = false;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "t:f:lh", options, NULL)) >= 0) {
+        switch (c) {
+        case 't':
+            min_ms = atoi(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < nitems(g_benches); i++) {
+        if (filter && strstr(g_benches[i].name, filter) == NULL) {
+            continue;
+        }
+
+        if (list) {
+            printf("%s\n", g_benches[i].name);
+        }
+
+        abc |= g_benches[i].abc;
+    }
+
+    if (list) {
+        exit(EXIT_SUCCESS);
+    }
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL || bench_init(ctx, abc) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < nitems(g_benches); i++) {
+        if (filter && strstr(g_benches[i].name, filter) == NULL) {
+            continue;
+        }
+
+        if (g_benches[i].abc && ctx->abc == NULL) {
+            continue;
+        }
+
+        bench_run(&g_benches[i], ctx, min_ms);
+    }
+
+    bench_deinit(ctx);
+    free(ctx);
+    exit(EXIT_SUCCESS);
+}
@@ -6,6 +6,7 @@
 #include "fakesensor.h"
 
 static struct sensor_light g_light;
+static volatile float g_constant_light;
 
 static struct parameters_s {
     enum data_pattern_e pattern;
@@ -36,6 +37,12 @@ static struct data_set_s get_fake_data(enum data_pattern_e pattern)
         data_set.size = sizeof(fakedata_low2high) / sizeof(float);
         break;
 
+    case DATA_PATTERN_CONSTANT:
+        /* Published from g_constant_light, see fakesensor_set_light() */
+        data_set.data = NULL;
+        data_set.size = 0;
+        break;
+
     default:
         exit(EXIT_FAILURE);
     }
@@ -73,9 +80,13 @@ static void *pub_thread_entry(void *arg)
         g_parameters.pattern, sample_rate, period_us);
     while (1) {
         g_light.timestamp = orb_absolute_time();
-        g_light.light = data_set.data[i++];
-        if (i == data_set.size)
-            i = 0;
+        if (data_set.data == NULL) {
+            g_light.light = g_constant_light;
+        } else {
+            g_light.light = data_set.data[i++];
+            if (i == data_set.size)
+                i = 0;
+        }
         if (OK != orb_publish(ORB_ID(sensor_light), fd, &g_light)) {
             fprintf(stderr, "publish failed\n");
             exit(EXIT_FAILURE);
@@ -111,6 +122,11 @@ pthread_t *fakesensor_start(enum data_pattern_e pattern, int sample_rate)
     return thread;
 }
 
+void fakesensor_set_light(float lux)
+{
+    g_constant_light = lux;
+}
+
 void fakesensor_stop(pthread_t *thread)
 {
     fprintf(stdout, "stop fake sensor thread\n");
@@ -37,6 +37,7 @@ enum data_pattern_e {
     DATA_PATTERN_STABLE,
     DATA_PATTERN_RAPID_CHANGE,
     DATA_PATTERN_LOW2HIGH,
+    DATA_PATTERN_CONSTANT, /* Lux set with fakesensor_set_light() */
 };
 
 /****************************************************************************
@@ -44,6 +45,7 @@ enum data_pattern_e {
  ****************************************************************************/
 
 pthread_t *fakesensor_start(enum data_pattern_e pattern, int sample_rate);
+void fakesensor_set_light(float lux);
 void fakesensor_stop(pthread_t *thread);
 
 #endif
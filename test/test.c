@@ -14,11 +14,28 @@
  * limitations under the License.
  */
 
+#include <float.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
 
+#include "../abc.h"
 #include "../brightness.h"
+#include "../display.h"
+#include "../spline.h"
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+#include "../fixedpoint.h"
+#endif
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_PERSISTENT
+#include "../persist.h"
+#endif
 
 #include "fakesensor.h"
 
@@ -201,6 +218,1005 @@ static int test_brightness_update_cb(void)
     return OK;
 }
 
+/* Spline edits, each checked against a spline created from scratch. */
+#define SPLINE_EDIT_LUX_MIN 1.0f
+#define SPLINE_EDIT_LUX_MAX 4000.0f
+#define SPLINE_EDIT_POWER_MAX 255.0f
+#define SPLINE_EDIT_CAPACITY 12
+#define SPLINE_EDIT_COUNT 500
+#define SPLINE_EDIT_PROBES 1000
+
+static uint32_t g_spline_edit_seed = 1;
+
+static uint32_t spline_edit_next(void)
+{
+    g_spline_edit_seed = g_spline_edit_seed * 1103515245 + 12345;
+    return g_spline_edit_seed >> 8;
+}
+
+static float spline_edit_random(float lo, float hi)
+{
+    return lo + (hi - lo) * spline_edit_next() / (float)(1 << 24);
+}
+
+/* Position of the first point not below x, where x would be inserted. */
+static int spline_edit_find(const float *lux, int n, float x)
+{
+    int i;
+
+    for (i = 0; i < n && lux[i] < x; i++)
+        ;
+
+    return i;
+}
+
+/* Pick a point that fits between points 'left' and 'right' of the curve. */
+static bool spline_edit_pick(const float *lux, const float *power, int n,
+                             int left, int right, float *x, float *y)
+{
+    float x0 = left >= 0 ? lux[left] : SPLINE_EDIT_LUX_MIN;
+    float x1 = right < n ? lux[right] : SPLINE_EDIT_LUX_MAX;
+
+    *x = spline_edit_random(x0, x1);
+    *y = spline_edit_random(left >= 0 ? power[left] : 0.0f,
+                            right < n ? power[right] : SPLINE_EDIT_POWER_MAX);
+    return *x > x0 && *x < x1;
+}
+
+static void spline_edit_add(float *lux, float *power, int *n, int i, float x,
+                            float y)
+{
+    memmove(lux + i + 1, lux + i, (*n - i) * sizeof(float));
+    memmove(power + i + 1, power + i, (*n - i) * sizeof(float));
+    lux[i] = x;
+    power[i] = y;
+    (*n)++;
+}
+
+static void spline_edit_del(float *lux, float *power, int *n, int i)
+{
+    (*n)--;
+    memmove(lux + i, lux + i + 1, (*n - i) * sizeof(float));
+    memmove(power + i, power + i + 1, (*n - i) * sizeof(float));
+}
+
+static void spline_edit_check(struct spline_s *spline, const float *lux,
+                              const float *power, int n, int edit)
+{
+    size_t size = spline_storage_size(NULL, n, n);
+    void *storage = malloc(size);
+    struct spline_s *expect;
+    struct spline_s *exact;
+    float x;
+    float y;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        spline_get_point(spline, i, &x, &y);
+        assert_msg(x == lux[i] && y == power[i],
+                   "Edit %d: point %d is %f %f, expected %f %f\n", edit, i, x,
+                   y, lux[i], power[i]);
+    }
+
+    assert_msg(spline_get_point(spline, n, &x, &y) < 0,
+               "Edit %d: more than %d points\n", edit, n);
+
+    expect = spline_create(lux, power, n);
+    assert_msg(expect != NULL, "Edit %d: failed to create spline\n", edit);
+    assert_msg(spline_lut_error(spline) == spline_lut_error(expect),
+               "Edit %d: table error %f, expected %f\n", edit,
+               spline_lut_error(spline), spline_lut_error(expect));
+
+    /* No room for a lookup table, evaluated exactly. */
+    exact = spline_init_storage(storage, size, lux, power, n, n);
+    assert_msg(exact != NULL, "Edit %d: failed to create spline\n", edit);
+
+    for (i = 0; i <= SPLINE_EDIT_PROBES; i++) {
+        x = SPLINE_EDIT_LUX_MIN *
+            powf(SPLINE_EDIT_LUX_MAX / SPLINE_EDIT_LUX_MIN,
+                 (float)i / SPLINE_EDIT_PROBES);
+        y = spline_interpolate(spline, x);
+        assert_msg(y == spline_interpolate(expect, x),
+                   "Edit %d: %f at lux %f, expected %f\n", edit, y, x,
+                   spline_interpolate(expect, x));
+        assert_msg(fabsf(y - spline_interpolate(exact, x)) <=
+                       spline_lut_error(spline),
+                   "Edit %d: table off by more than %f at lux %f\n", edit,
+                   spline_lut_error(spline), x);
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+        assert_msg(spline_interpolate_b16(spline, ftob16(x)) ==
+                       spline_interpolate_b16(expect, ftob16(x)),
+                   "Edit %d: fixed-point value differs at lux %f\n", edit, x);
+#endif
+    }
+
+    spline_destroy(expect);
+    free(storage);
+}
+
+static int test_spline_edit(void)
+{
+    static const float range[] = {SPLINE_EDIT_LUX_MIN, SPLINE_EDIT_LUX_MAX};
+    float lux[SPLINE_EDIT_CAPACITY] = {10, 100, 1000};
+    float power[SPLINE_EDIT_CAPACITY] = {20, 60, 200};
+    size_t size =
+        spline_storage_size(range, nitems(range), SPLINE_EDIT_CAPACITY);
+    void *storage = malloc(size);
+    struct spline_s *spline;
+    int edit;
+    int ret;
+    int n = 3;
+    int i;
+    int j;
+    float x;
+    float y;
+
+    test_log("Test spline edits.\n");
+    spline = spline_init_storage(storage, size, lux, power, n,
+                                 SPLINE_EDIT_CAPACITY);
+    assert_msg(spline != NULL, "Failed to create spline\n");
+    spline_edit_check(spline, lux, power, n, 0);
+
+    for (edit = 1; edit <= SPLINE_EDIT_COUNT; edit++) {
+        switch (spline_edit_next() % 4) {
+        case 0: /* Insert */
+            i = spline_edit_find(
+                lux, n,
+                spline_edit_random(SPLINE_EDIT_LUX_MIN, SPLINE_EDIT_LUX_MAX));
+            if (!spline_edit_pick(lux, power, n, i - 1, i, &x, &y)) {
+                continue;
+            }
+
+            ret = spline_insert_point(spline, x, y);
+            if (n == SPLINE_EDIT_CAPACITY) {
+                assert_msg(ret < 0, "Edit %d: inserted past capacity\n",
+                           edit);
+                break;
+            }
+
+            assert_msg(ret == i, "Edit %d: inserted at %d, expected %d\n",
+                       edit, ret, i);
+            spline_edit_add(lux, power, &n, i, x, y);
+            break;
+
+        case 1: /* Move between its neighbours */
+            i = spline_edit_next() % n;
+            if (!spline_edit_pick(lux, power, n, i - 1, i + 1, &x, &y)) {
+                continue;
+            }
+
+            ret = spline_move_point(spline, i, x, y);
+            assert_msg(ret == i, "Edit %d: moved to %d, expected %d\n", edit,
+                       ret, i);
+            lux[i] = x;
+            power[i] = y;
+            break;
+
+        case 2: /* Move anywhere, past other points */
+            i = spline_edit_next() % n;
+            if (n == 2) {
+                continue;
+            }
+
+            spline_edit_del(lux, power, &n, i);
+            j = spline_edit_find(
+                lux, n,
+                spline_edit_random(SPLINE_EDIT_LUX_MIN, SPLINE_EDIT_LUX_MAX));
+            if (!spline_edit_pick(lux, power, n, j - 1, j, &x, &y)) {
+                spline_get_point(spline, i, &x, &y);
+                spline_edit_add(lux, power, &n, i, x, y);
+                continue;
+            }
+
+            ret = spline_move_point(spline, i, x, y);
+            assert_msg(ret == j, "Edit %d: moved to %d, expected %d\n", edit,
+                       ret, j);
+            spline_edit_add(lux, power, &n, j, x, y);
+            break;
+
+        default: /* Remove */
+            i = spline_edit_next() % n;
+            ret = spline_remove_point(spline, i);
+            if (n == 2) {
+                assert_msg(ret < 0, "Edit %d: removed the last segment\n",
+                           edit);
+                break;
+            }
+
+            assert_msg(ret == OK, "Edit %d: failed to remove %d\n", edit, i);
+            spline_edit_del(lux, power, &n, i);
+            break;
+        }
+
+        spline_edit_check(spline, lux, power, n, edit);
+    }
+
+    /* A point that breaks monotonicity is refused, nothing changes. */
+    ret = spline_insert_point(spline, (lux[0] + lux[1]) / 2, power[1] + 1);
+    assert_msg(ret < 0, "Inserted a point that breaks monotonicity\n");
+    ret = spline_move_point(spline, 0, lux[0], power[1] + 1);
+    assert_msg(ret < 0, "Moved a point so that it breaks monotonicity\n");
+    spline_edit_check(spline, lux, power, n, edit);
+    free(storage);
+    return OK;
+}
+
+/* Not a multiple of the vector width, so the scalar tail runs too. */
+#define SPLINE_BATCH_COUNT 1027
+
+static void spline_batch_check(struct spline_s *spline, const float *x,
+                               const char *name)
+{
+    static float y[SPLINE_BATCH_COUNT];
+    static float z[SPLINE_BATCH_COUNT];
+    float expect;
+    int i;
+
+    spline_interpolate_batch(spline, x, y, SPLINE_BATCH_COUNT);
+    memcpy(z, x, sizeof(z));
+    spline_interpolate_batch(spline, z, z, SPLINE_BATCH_COUNT);
+
+    /* Bits are compared, NaN must come out as the same NaN. */
+    for (i = 0; i < SPLINE_BATCH_COUNT; i++) {
+        expect = spline_interpolate(spline, x[i]);
+        assert_msg(memcmp(&y[i], &expect, sizeof(expect)) == 0 &&
+                       memcmp(&z[i], &expect, sizeof(expect)) == 0,
+                   "%s batch: %f, in place %f at lux %f, expected %f\n",
+                   name, y[i], z[i], x[i], expect);
+    }
+}
+
+static int test_spline_batch(void)
+{
+    static const float lux[] = {
+        1,   2,   3,   5,   10,  20,   50,   100,  200,  300,
+        400, 500, 600, 700, 800, 1000, 1200, 1600, 2200, 3000,
+    };
+
+    static const float power[] = {
+        1,  5,  10, 20, 30, 46,  49,  54,  61,  65,
+        70, 76, 82, 87, 98, 108, 131, 161, 230, 255,
+    };
+
+    static struct spline_knot_s knots[nitems(lux)];
+    static float x[SPLINE_BATCH_COUNT];
+    struct spline_s linear = {
+        .knots = knots,
+        .n = nitems(knots),
+        .capacity = nitems(knots),
+        .type = SPLINE_TYPE_LINEAR,
+    };
+
+    size_t size = spline_storage_size(NULL, nitems(lux), nitems(lux));
+    void *storage = malloc(size);
+    struct spline_s *spline;
+    int n = 0;
+    int i;
+
+    test_log("Test spline batch interpolation.\n");
+
+    /* Knots and their neighbours, values the ends clamp, then random lux
+     * in random order. */
+    for (i = 0; i < nitems(lux); i++) {
+        x[n++] = lux[i];
+        x[n++] = nextafterf(lux[i], 0.0f);
+        x[n++] = nextafterf(lux[i], INFINITY);
+        knots[i].x = lux[i];
+        knots[i].y = power[i];
+        knots[i].m = i + 1 < nitems(lux) ? (power[i + 1] - power[i]) /
+                                               (lux[i + 1] - lux[i])
+                                         : 0.0f;
+    }
+
+    x[n++] = NAN;
+    x[n++] = -NAN;
+    x[n++] = INFINITY;
+    x[n++] = -INFINITY;
+    x[n++] = 0.0f;
+    x[n++] = -1.0f;
+    x[n++] = FLT_MIN / 2;
+    x[n++] = 5000.0f;
+    while (n < SPLINE_BATCH_COUNT) {
+        x[n++] = 0.5f * powf(8000.0f, spline_edit_random(0.0f, 1.0f));
+    }
+
+    spline = spline_create(lux, power, nitems(lux));
+    assert_msg(spline != NULL, "Failed to create spline\n");
+    spline_batch_check(spline, x, "Cubic");
+    spline_destroy(spline);
+
+    /* No room for a lookup table, evaluated exactly. */
+    spline = spline_init_storage(storage, size, lux, power, nitems(lux),
+                                 nitems(lux));
+    assert_msg(spline != NULL, "Failed to create spline\n");
+    spline_batch_check(spline, x, "Exact cubic");
+    spline_batch_check(&linear, x, "Linear");
+    free(storage);
+    return OK;
+}
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+/* Documented tolerance of the fixed-point engine, in brightness levels. */
+#define FIXEDPOINT_TOLERANCE 0.05f
+
+static int test_fixedpoint_engine(void)
+{
+    static const float curve_lux[] = {
+        1,   2,   3,   5,   10,  20,   50,   100,  200,  300,
+        400, 500, 600, 700, 800, 1000, 1200, 1600, 2200, 3000,
+    };
+
+    static const float curve_power[] = {
+        1,  5,  10, 20, 30, 46,  49,  54,  61,  65,
+        70, 76, 82, 87, 98, 108, 131, 161, 230, 255,
+    };
+
+    struct spline_s *spline;
+    float power[nitems(curve_power)];
+    float expect;
+    float error;
+    b16_t gamma;
+    b16_t y;
+    int i;
+
+    /* Same curves as an adjusted auto brightness curve, gamma 0.5 to 2. */
+    for (gamma = b16HALF; gamma <= itob16(2); gamma += b16ONE / 4) {
+        for (i = 0; i < nitems(curve_power); i++) {
+            expect = powf(curve_power[i] / 255.0f, b16tof(gamma)) * 255.0f;
+            y = b16pow(b16divb16(ftob16(curve_power[i]), itob16(255)), gamma);
+            power[i] = expect;
+
+            error = fabsf(b16tof(b16mulb16(y, itob16(255))) - expect);
+            assert_msg(error <= FIXEDPOINT_TOLERANCE,
+                       "Fixed-point power error %f at %f, gamma %f\n", error,
+                       curve_power[i], b16tof(gamma));
+        }
+
+        spline = spline_create(curve_lux, power, nitems(curve_lux));
+        assert_msg(spline != NULL, "Failed to create spline\n");
+
+        for (b16_t lux = 0; lux <= itob16(4000); lux += b16ONE / 8) {
+            expect = spline_interpolate(spline, b16tof(lux));
+            y = spline_interpolate_b16(spline, lux);
+            error = fabsf(b16tof(y) - expect);
+            assert_msg(error <= FIXEDPOINT_TOLERANCE,
+                       "Fixed-point spline error %f at lux %f, gamma %f\n",
+                       error, b16tof(lux), b16tof(gamma));
+        }
+
+        spline_destroy(spline);
+    }
+
+    test_log("Fixed-point engine matches float engine.\n");
+    return OK;
+}
+#endif
+
+/* Lux of the response test, far apart in both directions. */
+#define RESPONSE_DARK_LUX 10.0f
+#define RESPONSE_BRIGHT_LUX 1000.0f
+#define RESPONSE_POLL_MS 10
+#define RESPONSE_SLACK_MS 500 /* Ramp step and sample delivery */
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Wait until the backlight holds its level for a second. */
+static int wait_level_steady(void)
+{
+    int64_t since = now_ms();
+    int level = brightness_get_current_level();
+    int current;
+
+    while (now_ms() - since < 1000) {
+        usleep(RESPONSE_POLL_MS * 1000);
+        current = brightness_get_current_level();
+        if (current != level) {
+            level = current;
+            since = now_ms();
+        }
+    }
+
+    return level;
+}
+
+/**
+ * Step the fake sensor to 'lux' and measure the time until the backlight
+ * moves, which must be within the settle time of that direction.
+ */
+static int64_t measure_response(float lux, int settle_ms, int period_ms)
+{
+    int64_t limit = settle_ms + 2 * period_ms + RESPONSE_SLACK_MS;
+    int level = wait_level_steady();
+    int64_t start;
+    int64_t latency;
+
+    fakesensor_set_light(lux);
+    start = now_ms();
+    do {
+        usleep(RESPONSE_POLL_MS * 1000);
+        latency = now_ms() - start;
+    } while (brightness_get_current_level() == level && latency <= limit);
+
+    assert_msg(latency <= limit,
+               "No response to %.0f lux in %" PRId64 " ms, level %d\n", lux,
+               latency, level);
+    return latency;
+}
+
+static int test_response_latency(brightness_session_t *session,
+                                 int sample_rate)
+{
+    int period_ms = 1000 / (sample_rate > 0 ? sample_rate : 2);
+    pthread_t *fakesensor;
+    int64_t brighten;
+    int64_t darken;
+    int ret;
+
+    test_log("Test brighten and darken response.\n");
+    fakesensor_set_light(RESPONSE_DARK_LUX);
+    fakesensor = fakesensor_start(DATA_PATTERN_CONSTANT, sample_rate);
+
+    ret = brightness_set_mode(session, BRIGHTNESS_MODE_AUTO);
+    assert_msg(ret == 0, "Failed to set mode, %d, %s\n", ret, strerror(errno));
+
+    brighten = measure_response(RESPONSE_BRIGHT_LUX,
+                                CONFIG_LIGHTSENSOR_BRIGHTEN_TIME, period_ms);
+    darken = measure_response(RESPONSE_DARK_LUX,
+                              CONFIG_LIGHTSENSOR_DARKEN_TIME, period_ms);
+
+    test_log("Sensor to write latency, brighten: %" PRId64 " ms (%d ms), "
+             "darken: %" PRId64 " ms (%d ms)\n",
+             brighten, CONFIG_LIGHTSENSOR_BRIGHTEN_TIME, darken,
+             CONFIG_LIGHTSENSOR_DARKEN_TIME);
+
+    fakesensor_stop(fakesensor);
+    ret = brightness_set_mode(session, BRIGHTNESS_MODE_MANUAL);
+    assert_msg(ret == 0, "Failed to set mode, %d, %s\n", ret, strerror(errno));
+    return OK;
+}
+
+/* Lux of the reacquire test, a step within the dramatic change thresholds
+ * on a steep part of the default curve, which waits for the settle time. */
+#define REACQUIRE_LOW_LUX 1600.0f
+#define REACQUIRE_HIGH_LUX 2200.0f
+#define REACQUIRE_MANUAL_LEVEL 30
+
+/* Switch to auto mode, where the first new sample sets brightness. */
+static void reacquire_auto(brightness_session_t *session, float lux,
+                           int period_ms)
+{
+    int ret;
+
+    ret = brightness_set_mode(session, BRIGHTNESS_MODE_MANUAL);
+    ret |= brightness_set_target(session, REACQUIRE_MANUAL_LEVEL, 0);
+    fakesensor_set_light(lux);
+    usleep(2 * period_ms * 1000);
+    ret |= brightness_set_mode(session, BRIGHTNESS_MODE_AUTO);
+    assert_msg(ret == 0, "Failed to switch to auto, %d, %s\n", ret,
+               strerror(errno));
+}
+
+/**
+ * Time until the backlight reaches 'level', which must be within two
+ * samples and a fast ramp over 'distance', short of the settle time.
+ */
+static int64_t measure_reacquire(int level, int distance, int period_ms)
+{
+    int64_t limit = 2 * period_ms + RESPONSE_SLACK_MS +
+                    distance * 1000 / CONFIG_LIGHTSENSOR_FAST_RAMP;
+    int64_t start = now_ms();
+    int64_t latency;
+
+    do {
+        usleep(RESPONSE_POLL_MS * 1000);
+        latency = now_ms() - start;
+    } while (brightness_get_current_level() != level && latency <= limit);
+
+    assert_msg(latency <= limit,
+               "Level %d not reached in %" PRId64 " ms, at %d\n", level,
+               latency, brightness_get_current_level());
+    return latency;
+}
+
+/**
+ * Lux changes while the panel is off or abc is dormant in manual mode are
+ * followed as soon as auto brightness is back, without the settle time.
+ */
+static int test_reacquire(brightness_session_t *session, int sample_rate)
+{
+    int period_ms = 1000 / (sample_rate > 0 ? sample_rate : 2);
+    pthread_t *fakesensor;
+    int64_t display_on;
+    int64_t auto_on;
+    int distance;
+    int high;
+    int low;
+    int ret;
+
+    test_log("Test reacquire after display off and manual mode.\n");
+    fakesensor_set_light(REACQUIRE_HIGH_LUX);
+    fakesensor = fakesensor_start(DATA_PATTERN_CONSTANT, sample_rate);
+
+    /* Levels of both lux, each set by the first sample in auto mode */
+    reacquire_auto(session, REACQUIRE_HIGH_LUX, period_ms);
+    high = wait_level_steady();
+    reacquire_auto(session, REACQUIRE_LOW_LUX, period_ms);
+    low = wait_level_steady();
+    assert_msg(high > low, "Level %d at %.0f lux, %d at %.0f lux\n", high,
+               REACQUIRE_HIGH_LUX, low, REACQUIRE_LOW_LUX);
+
+    /* Brighter while the panel is off */
+    ret = brightness_set_target(session, BRIGHTNESS_LEVEL_OFF, 0);
+    assert_msg(ret == 0, "Failed to turn off, %d, %s\n", ret,
+               strerror(errno));
+    fakesensor_set_light(REACQUIRE_HIGH_LUX);
+    usleep(2 * period_ms * 1000);
+    ret = brightness_set_target(session, low, 0);
+    assert_msg(ret == 0, "Failed to turn on, %d, %s\n", ret,
+               strerror(errno));
+    display_on = measure_reacquire(high, high - low, period_ms);
+
+    /* Darker while abc is dormant in manual mode */
+    reacquire_auto(session, REACQUIRE_LOW_LUX, period_ms);
+    distance = MAX(high, REACQUIRE_MANUAL_LEVEL) -
+               MIN(low, REACQUIRE_MANUAL_LEVEL);
+    auto_on = measure_reacquire(low, distance, period_ms);
+
+    test_log("Reacquire latency, display on: %" PRId64 " ms, auto mode: "
+             "%" PRId64 " ms, settle %d ms and %d ms\n",
+             display_on, auto_on, CONFIG_LIGHTSENSOR_BRIGHTEN_TIME,
+             CONFIG_LIGHTSENSOR_DARKEN_TIME);
+
+    fakesensor_stop(fakesensor);
+    ret = brightness_set_mode(session, BRIGHTNESS_MODE_MANUAL);
+    assert_msg(ret == 0, "Failed to set mode, %d, %s\n", ret, strerror(errno));
+    return OK;
+}
+
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_MOCK
+/**
+ * Ramp tests run on a mock display of their own, the panel stays with the
+ * service. Ramp of the curve test, and where a linear one is half way.
+ */
+#define RAMP_CURVE_DEVICE "mock:10" /* Starts at RAMP_CURVE_FROM */
+#define RAMP_CURVE_FROM 10
+#define RAMP_CURVE_TO 200
+#define RAMP_CURVE_SPEED 190
+#define RAMP_CURVE_MIDDLE ((RAMP_CURVE_FROM + RAMP_CURVE_TO) / 2)
+#define RAMP_CURVE_SLACK_MS 100 /* Last step and timer latency */
+
+struct ramp_record_s {
+    uv_loop_t *loop;
+    struct display_brightness_s *display;
+    uv_timer_t half_timer; /* Samples the level half way */
+    int half_level;        /* Level half way through the ramp */
+    int level;             /* Last level written */
+    uint64_t time;         /* Time of the last write */
+    bool monotonic;
+};
+
+static void ramp_record_cb(int type, intptr_t arg, void *user_data)
+{
+    struct ramp_record_s *record = user_data;
+
+    if (arg < record->level) {
+        record->monotonic = false;
+    }
+
+    record->time = uv_now(record->loop);
+    record->level = arg;
+}
+
+/* Ask the display, as a ramp may write no level right at half way. */
+static void ramp_half_cb(uv_timer_t *handle)
+{
+    struct ramp_record_s *record = handle->data;
+
+    display_brightness_get(record->display, &record->half_level);
+}
+
+/* Ramp the display directly, so the ramp curve can be chosen. */
+static int ramp_with_curve(enum display_ramp_curve_e curve)
+{
+    struct display_brightness_s *display;
+    struct ramp_record_s record;
+    uint64_t end;
+    uv_loop_t loop;
+    int ret;
+
+    uv_loop_init(&loop);
+    display = display_brightness_open_device(RAMP_CURVE_DEVICE, &loop);
+    assert_msg(display != NULL, "Failed to open mock display\n");
+
+    memset(&record, 0, sizeof(record));
+    record.loop = &loop;
+    record.display = display;
+    record.level = RAMP_CURVE_FROM;
+    record.monotonic = true;
+    display_brightness_set_update_cb(display, ramp_record_cb, &record);
+
+    ret = display_brightness_set(display, RAMP_CURVE_TO, RAMP_CURVE_SPEED,
+                                 curve);
+    assert_msg(ret == 0, "Failed to set brightness, %d\n", ret);
+    display_brightness_get_ramp_end(display, &end);
+
+    uv_timer_init(&loop, &record.half_timer);
+    record.half_timer.data = &record;
+    uv_timer_start(&record.half_timer, ramp_half_cb,
+                   (end - uv_now(&loop)) / 2, 0);
+
+    /* The loop runs until the ramp and half way timers stop. */
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    assert_msg(record.monotonic, "Ramp went backwards, curve %d\n", curve);
+    assert_msg(record.level == RAMP_CURVE_TO,
+               "Ramp stopped at %d, curve %d\n", record.level, curve);
+    assert_msg(record.time <= end + RAMP_CURVE_SLACK_MS,
+               "Ramp ended %" PRIu64 " ms late, curve %d\n",
+               record.time - end, curve);
+
+    uv_close((uv_handle_t *)&record.half_timer, NULL);
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    return record.half_level;
+}
+
+static int test_ramp_curves(void)
+{
+    int linear;
+    int perceptual;
+
+    test_log("Test ramp curves.\n");
+    linear = ramp_with_curve(DISPLAY_RAMP_LINEAR);
+    perceptual = ramp_with_curve(DISPLAY_RAMP_PERCEPTUAL);
+
+    /* Lightness changes evenly, so the level stays low for longer. */
+    assert_msg(abs(linear - RAMP_CURVE_MIDDLE) <= RAMP_CURVE_SPEED / 10,
+               "Linear ramp at %d half way, expect %d\n", linear,
+               RAMP_CURVE_MIDDLE);
+    assert_msg(perceptual < linear,
+               "Perceptual ramp at %d half way, linear at %d\n", perceptual,
+               linear);
+    return OK;
+}
+
+/* A timer ramp writes at most once per timer period, and ends on time. */
+static void ramp_mock_writes(enum display_ramp_curve_e curve)
+{
+    struct display_mock_write_s writes[DISPLAY_MOCK_WRITES_MAX];
+    struct display_brightness_s *display;
+    uint64_t start;
+    uint64_t end;
+    uint64_t gap;
+    uv_loop_t loop;
+    int limit;
+    int n;
+    int i;
+
+    uv_loop_init(&loop);
+    display = display_brightness_open_device(RAMP_CURVE_DEVICE, &loop);
+    assert_msg(display != NULL, "Failed to open mock display\n");
+
+    start = uv_now(&loop);
+    display_brightness_set(display, RAMP_CURVE_TO, RAMP_CURVE_SPEED, curve);
+    display_brightness_get_ramp_end(display, &end);
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    n = display_mock_get_writes(display, writes, DISPLAY_MOCK_WRITES_MAX);
+    limit = (end - start) / DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD + 1;
+    assert_msg(n > 0 && n <= limit, "Ramp wrote %d times, limit %d\n", n,
+               limit);
+    for (i = 1; i < n; i++) {
+        gap = writes[i].time - writes[i - 1].time;
+        assert_msg(writes[i].level > writes[i - 1].level &&
+                       gap >= DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD,
+                   "Ramp write %d at %" PRIu64 " ms, level %d\n", i,
+                   writes[i].time - start, writes[i].level);
+    }
+
+    assert_msg(writes[n - 1].level == RAMP_CURVE_TO &&
+                   writes[n - 1].time <=
+                       end + DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD,
+               "Ramp ended at %d, %" PRIu64 " ms\n", writes[n - 1].level,
+               writes[n - 1].time - start);
+
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+static int test_ramp_writes(void)
+{
+    test_log("Test ramp writes on a mock display.\n");
+    ramp_mock_writes(DISPLAY_RAMP_LINEAR);
+    ramp_mock_writes(DISPLAY_RAMP_PERCEPTUAL);
+    return OK;
+}
+
+/* User points of the curve tests, by time set, and the lux checked. */
+static const int g_user_points[][2] = {{20, 40}, {300, 170}, {60, 120}};
+static const int g_user_check_lux[] = {1, 10, 40, 100, 500, 2000, 10000};
+
+/* Brightness at 'lux' once the controller has built its curve. */
+static int user_curve_level(uv_loop_t *loop, struct abc_s *abc, int lux)
+{
+    int level;
+
+    while ((level = abc_test_get_brightness(abc, lux)) == -EBUSY) {
+        uv_run(loop, UV_RUN_ONCE);
+    }
+
+    return level;
+}
+
+/**
+ * Points set back to back, while the curve of the first one is built,
+ * must give the curve of the same points set one at a time.
+ */
+static int test_user_points_back_to_back(void)
+{
+    struct display_brightness_s *display;
+    struct abc_s *batch;
+    struct abc_s *single;
+    uv_loop_t loop;
+    int expect;
+    int level;
+    int i;
+
+    test_log("Test user points set back to back.\n");
+    uv_loop_init(&loop);
+    display = display_brightness_open_device(RAMP_CURVE_DEVICE, &loop);
+    assert_msg(display != NULL, "Failed to open mock display\n");
+
+    batch = abc_init(&loop, display);
+    single = abc_init(&loop, display);
+    assert_msg(batch != NULL && single != NULL, "Failed to start abc\n");
+
+    for (i = 0; i < nitems(g_user_points); i++) {
+        abc_test_set_user_point(batch, g_user_points[i][0],
+                                g_user_points[i][1]);
+    }
+
+    for (i = 0; i < nitems(g_user_points); i++) {
+        abc_test_set_user_point(single, g_user_points[i][0],
+                                g_user_points[i][1]);
+        user_curve_level(&loop, single, g_user_points[i][0]);
+    }
+
+    for (i = 0; i < nitems(g_user_check_lux); i++) {
+        level = user_curve_level(&loop, batch, g_user_check_lux[i]);
+        expect = user_curve_level(&loop, single, g_user_check_lux[i]);
+        assert_msg(level == expect, "Level %d at %d lux, expected %d\n",
+                   level, g_user_check_lux[i], expect);
+    }
+
+    abc_deinit(batch);
+    abc_deinit(single);
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    return OK;
+}
+
+/**
+ * Adjustments that follow each other keep the gamma of the first one, so
+ * the curve is edited in place of rebuilt. The result must be the curve
+ * rebuilt from the same points and gamma. The first adjustment asks for
+ * black at 10 lux, which sets gamma to MAX_GAMMA exactly.
+ */
+static int test_user_points_session(void)
+{
+    static const int adjust[][2] = {
+        {10, 0},   {100, 80}, {30, 20},    {1000, 200},
+        {300, 60}, {30, 50},  {2000, 240}, {100, 70},
+    };
+
+    int lux[CONFIG_BRIGHTNESS_USER_POINTS];
+    int target[CONFIG_BRIGHTNESS_USER_POINTS];
+    struct display_brightness_s *display;
+    struct abc_s *rebuilt;
+    struct abc_s *abc;
+    uv_loop_t loop;
+    int updates;
+    int expect;
+    int level;
+    int gamma;
+    int i;
+    int n;
+
+    test_log("Test user points of one session.\n");
+    uv_loop_init(&loop);
+    display = display_brightness_open_device(RAMP_CURVE_DEVICE, &loop);
+    assert_msg(display != NULL, "Failed to open mock display\n");
+
+    abc = abc_init(&loop, display);
+    rebuilt = abc_init(&loop, display);
+    assert_msg(abc != NULL && rebuilt != NULL, "Failed to start abc\n");
+
+    for (i = 0; i < nitems(adjust); i++) {
+        abc_test_set_user_point(abc, adjust[i][0], adjust[i][1]);
+        user_curve_level(&loop, abc, adjust[i][0]);
+    }
+
+    /* Only the first adjustment builds the curve from the default one. */
+    updates = abc_test_get_curve_updates(abc);
+    assert_msg(updates == nitems(adjust) - 1,
+               "%d of %d adjustments edited the curve\n", updates,
+               (int)nitems(adjust) - 1);
+
+    gamma = abc_get_user_gamma(abc);
+    assert_msg(gamma == 2 * BRIGHTNESS_USER_GAMMA_ONE,
+               "Gamma %d, expected %d\n", gamma, 2 * BRIGHTNESS_USER_GAMMA_ONE);
+
+    n = abc_get_user_points(abc, lux, target, nitems(lux));
+    abc_set_user_points(rebuilt, lux, target, n, gamma);
+    for (i = 0; i < nitems(g_user_check_lux); i++) {
+        level = user_curve_level(&loop, abc, g_user_check_lux[i]);
+        expect = user_curve_level(&loop, rebuilt, g_user_check_lux[i]);
+        assert_msg(level == expect, "Level %d at %d lux, expected %d\n",
+                   level, g_user_check_lux[i], expect);
+    }
+
+    /* A new session sets gamma again, which rebuilds the curve. */
+    abc_test_end_session(abc);
+    abc_test_set_user_point(abc, 500, 250);
+    user_curve_level(&loop, abc, 500);
+    assert_msg(abc_get_user_gamma(abc) != gamma, "Gamma held past session\n");
+    assert_msg(abc_test_get_curve_updates(abc) == updates,
+               "Curve of a new gamma was edited\n");
+
+    abc_deinit(abc);
+    abc_deinit(rebuilt);
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    return OK;
+}
+
+/* Learned points, oldest first, must be the 'n' expected ones. */
+static void user_points_expect(uv_loop_t *loop, struct abc_s *abc,
+                               const int expect[][2], int n)
+{
+    int lux[CONFIG_BRIGHTNESS_USER_POINTS];
+    int target[CONFIG_BRIGHTNESS_USER_POINTS];
+    int count;
+    int i;
+
+    user_curve_level(loop, abc, 1);
+    count = abc_get_user_points(abc, lux, target, nitems(lux));
+    assert_msg(count == n, "%d user points, expected %d\n", count, n);
+    for (i = 0; i < n; i++) {
+        assert_msg(lux[i] == expect[i][0] && target[i] == expect[i][1],
+                   "User point %d is %d:%d, expected %d:%d\n", i, lux[i],
+                   target[i], expect[i][0], expect[i][1]);
+    }
+}
+
+/* New points replace the ones at close lux and the ones they contradict,
+ * the oldest goes once all are taken. Saved points load as they are. */
+static int test_user_points_learn(void)
+{
+    static const int merged[][2] = {{120, 110}};
+    static const int contradicted[][2] = {{400, 80}};
+    static const int restored[][2] = {{20, 40}, {300, 170}};
+    int expect[CONFIG_BRIGHTNESS_USER_POINTS][2];
+    struct display_brightness_s *display;
+    struct abc_s *abc;
+    uv_loop_t loop;
+    int lux[2];
+    int target[2];
+    int i;
+    int n;
+
+    test_log("Test user points learned.\n");
+    uv_loop_init(&loop);
+    display = display_brightness_open_device(RAMP_CURVE_DEVICE, &loop);
+    assert_msg(display != NULL, "Failed to open mock display\n");
+    abc = abc_init(&loop, display);
+    assert_msg(abc != NULL, "Failed to start abc\n");
+
+    abc_test_set_user_point(abc, 100, 100);
+    abc_test_set_user_point(abc, 120, 110);
+    user_points_expect(&loop, abc, merged, nitems(merged));
+
+    /* Darker at higher lux than 120:110, which goes */
+    abc_test_set_user_point(abc, 400, 80);
+    user_points_expect(&loop, abc, contradicted, nitems(contradicted));
+
+    /* All the points at once, brightest first, then one more */
+    abc_set_user_points(abc, NULL, NULL, 0, BRIGHTNESS_USER_GAMMA_ONE);
+    n = CONFIG_BRIGHTNESS_USER_POINTS;
+    for (i = n; i > 0; i--) {
+        abc_test_set_user_point(abc, 2 << i, 20 + 25 * i);
+    }
+
+    abc_test_set_user_point(abc, 2, 10);
+    for (i = 0; i < n - 1; i++) {
+        expect[i][0] = 2 << (n - 1 - i);
+        expect[i][1] = 20 + 25 * (n - 1 - i);
+    }
+
+    expect[n - 1][0] = 2;
+    expect[n - 1][1] = 10;
+    user_points_expect(&loop, abc, expect, n);
+
+    for (i = 0; i < nitems(restored); i++) {
+        lux[i] = restored[i][0];
+        target[i] = restored[i][1];
+    }
+
+    assert_msg(abc_set_user_points(abc, lux, target, 2, 0) == -EINVAL,
+               "Gamma 0 is taken\n");
+    assert_msg(abc_set_user_points(abc, lux, target, 2, 1500) == OK,
+               "Failed to set user points\n");
+    n = MIN(nitems(restored), CONFIG_BRIGHTNESS_USER_POINTS);
+    user_points_expect(&loop, abc, restored + nitems(restored) - n, n);
+    assert_msg(abc_get_user_gamma(abc) == 1500, "Gamma %d, expected 1500\n",
+               abc_get_user_gamma(abc));
+
+    abc_deinit(abc);
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+    return OK;
+}
+#endif
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_PERSISTENT
+/* Saved user point value, oldest first. */
+static int test_user_points_format(void)
+{
+    static const int lux[] = {20, 300, 60};
+    static const int target[] = {40, 170, 120};
+    char buf[32];
+    int parsed_lux[nitems(lux)];
+    int parsed_target[nitems(lux)];
+    int ret;
+    int n;
+    int i;
+
+    test_log("Test user points format.\n");
+    ret = brightness_test_format_user_points(buf, sizeof(buf), lux, target,
+                                             nitems(lux));
+    assert_msg(ret == OK && strcmp(buf, "20:40,300:170,60:120") == 0,
+               "Formatted as '%s'\n", buf);
+
+    n = brightness_test_parse_user_points(buf, parsed_lux, parsed_target,
+                                          nitems(parsed_lux));
+    assert_msg(n == nitems(lux), "Parsed %d points\n", n);
+    for (i = 0; i < n; i++) {
+        assert_msg(parsed_lux[i] == lux[i] && parsed_target[i] == target[i],
+                   "Point %d parsed as %d:%d\n", i, parsed_lux[i],
+                   parsed_target[i]);
+    }
+
+    /* Too long for the buffer */
+    ret = brightness_test_format_user_points(buf, 8, lux, target,
+                                             nitems(lux));
+    assert_msg(ret == ERROR, "Formatted '%s' into 8 bytes\n", buf);
+
+    /* Points up to a bad one or the array size */
+    n = brightness_test_parse_user_points("5:6,junk", parsed_lux,
+                                          parsed_target, nitems(parsed_lux));
+    assert_msg(n == 1 && parsed_lux[0] == 5 && parsed_target[0] == 6,
+               "Parsed %d points from '5:6,junk'\n", n);
+    n = brightness_test_parse_user_points("", parsed_lux, parsed_target,
+                                          nitems(parsed_lux));
+    assert_msg(n == 0, "Parsed %d points from nothing\n", n);
+    n = brightness_test_parse_user_points("1:2,3:4,5:6,7:8", parsed_lux,
+                                          parsed_target, 2);
+    assert_msg(n == 2 && parsed_lux[1] == 3, "Parsed %d of 2 points\n", n);
+    return OK;
+}
+#endif
+
 static int operation_test(brightness_session_t *session, int sample_rate)
 {
     int ret;
@@ -208,10 +1224,17 @@ static int operation_test(brightness_session_t *session, int sample_rate)
 
     brightness_session_t *sys_session = brightness_get_system_session();
 
+#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+    test_fixedpoint_engine();
+#endif
+
     /* Set system session to manual mode */
     brightness_set_mode(sys_session, BRIGHTNESS_MODE_MANUAL);
     brightness_set_target(sys_session, 10, 0);
 
+    test_spline_edit();
+    test_spline_batch();
+
     /* Basic test */
     test_brightness_basic_ops(session);
     test_brightness_update_cb();
@@ -232,6 +1255,18 @@ static int operation_test(brightness_session_t *session, int sample_rate)
     brightness = brightness_get_current_level();
     assert_msg(brightness == 100, "Brightness value not reached target\n");
 
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_MOCK
+    test_ramp_curves();
+    test_ramp_writes();
+    test_user_points_back_to_back();
+    test_user_points_session();
+    test_user_points_learn();
+#endif
+
+#ifdef CONFIG_BRIGHTNESS_SERVICE_PERSISTENT
+    test_user_points_format();
+#endif
+
     /* Enable auto brightness mode */
     test_log("Change mode to auto.\n");
 
@@ -248,6 +1283,9 @@ static int operation_test(brightness_session_t *session, int sample_rate)
     ret = brightness_set_mode(session, BRIGHTNESS_MODE_MANUAL);
     assert_msg(ret == 0, "Failed to set mode, %d, %s\n", ret, strerror(errno));
     sleep(1);
+
+    test_response_latency(session, sample_rate);
+    test_reacquire(session, sample_rate);
     test_log("Brightness test passed.\n");
     return 0;
 }
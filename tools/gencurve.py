@@ -0,0 +1,313 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2024 Xiaomi Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""
+Generate the default brightness curve header from a curve file.
+
+The curve file has one control point per line, "lux backlight", separated
+by spaces or a comma. Text after '#' is a comment.
+
+The header holds the control points, the knots with tangents computed the
+same way as spline.c does in float, the optional lookup table, and a
+read-only static spline using them, so no setup is needed at runtime.
+"""
+
+import argparse
+import math
+import os
+import struct
+import sys
+
+B16_ONE = 65536
+B16_X_MAX = 32767.0
+B16_Y_MAX = 2048.0
+
+# Rounding of a lookup table interpolation, same as LUT_ROUNDING
+LUT_ROUNDING = 16.0 * 2.0**-23
+
+
+def f32(v):
+    """Round to float, so that results match float arithmetic in C."""
+    return struct.unpack("f", struct.pack("f", v))[0]
+
+
+def b16(v):
+    """Same as ftob16(), truncates toward zero."""
+    return int(v * B16_ONE)
+
+
+def cfloat(v):
+    s = "%.9g" % v
+    if not any(c in s for c in ".en"):
+        s += ".0"
+    return s + "f"
+
+
+def parse_curve(path):
+    x = []
+    y = []
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].replace(",", " ").strip()
+            if not line:
+                continue
+
+            fields = line.split()
+            if len(fields) != 2:
+                sys.exit("%s:%d: expected 'lux backlight'" % (path, lineno))
+
+            x.append(f32(float(fields[0])))
+            y.append(f32(float(fields[1])))
+
+    if len(x) < 2:
+        sys.exit("%s: there must be at least two control points" % path)
+
+    for i in range(1, len(x)):
+        if x[i] <= x[i - 1]:
+            sys.exit("%s: lux must be strictly increasing" % path)
+        if y[i] < y[i - 1]:
+            sys.exit("%s: backlight must not decrease" % path)
+
+    return x, y
+
+
+def secant(x, y, i):
+    return f32(f32(y[i + 1] - y[i]) / f32(x[i + 1] - x[i]))
+
+
+def initial_tangent(x, y, i):
+    n = len(x)
+    if i == 0:
+        return secant(x, y, 0)
+    if i == n - 1:
+        return secant(x, y, n - 2)
+    return f32(f32(secant(x, y, i - 1) + secant(x, y, i)) * 0.5)
+
+
+def monotone_cubic_tangents(x, y):
+    """Same as monotone_cubic_spline_update() over the whole curve."""
+    n = len(x)
+    m = [0.0] * n
+    mid = [0.0] * n
+    mid[0] = initial_tangent(x, y, 0)
+    for i in range(n - 1):
+        cur = mid[i]
+        nxt = initial_tangent(x, y, i + 1)
+        d = secant(x, y, i)
+        if d == 0.0:
+            cur = 0.0
+            nxt = 0.0
+        else:
+            a = f32(cur / d)
+            b = f32(nxt / d)
+            h = f32(math.hypot(a, b))
+            if h > 3.0:
+                t = f32(3.0 / h)
+                cur = f32(cur * t)
+                nxt = f32(nxt * t)
+
+        m[i] = cur
+        mid[i + 1] = nxt
+
+    m[n - 1] = mid[n - 1]
+    return m, mid
+
+
+def interpolate(x, y, m, v):
+    """Cubic Hermite evaluation, as monotone_cubic_spline_interpolate()."""
+    if v <= x[0]:
+        return y[0]
+    if v >= x[-1]:
+        return y[-1]
+
+    i = max(j for j in range(len(x)) if x[j] <= v)
+    h = x[i + 1] - x[i]
+    t = (v - x[i]) / h
+    return (y[i] * (1 + 2 * t) + h * m[i] * t) * (1 - t) * (1 - t) + (
+        y[i + 1] * (3 - 2 * t) + h * m[i + 1] * (t - 1)
+    ) * t * t
+
+
+def lut_log2(v):
+    """Same as lut_log2() in spline.c."""
+    mant, e = math.frexp(v)
+    return f32((e - 1) + f32(f32(2.0 * mant) - 1.0))
+
+
+def lut_exp2(u):
+    k = math.floor(u)
+    return f32(math.ldexp(f32(1.0 + f32(u - k)), k))
+
+
+def hermite_curvature(x, y, m, i, t):
+    h = x[i + 1] - x[i]
+    return (
+        (12 * t - 6) * (y[i] - y[i + 1])
+        + (6 * t - 4) * h * m[i]
+        + (6 * t - 2) * h * m[i + 1]
+    ) / (h * h)
+
+
+def lut_cell_error(x, y, m, i, a, b):
+    """Same as lut_cell_error() in spline.c for a cubic spline."""
+    curvature = 0.0
+    while i < len(x) - 1 and x[i] < b:
+        h = x[i + 1] - x[i]
+        t0 = max((a - x[i]) / h, 0.0)
+        t1 = min((b - x[i]) / h, 1.0)
+        curvature = max(
+            curvature,
+            abs(hermite_curvature(x, y, m, i, t0)),
+            abs(hermite_curvature(x, y, m, i, t1)),
+        )
+        i += 1
+
+    return curvature * (b - a) * (b - a) / 8
+
+
+def lookup_table(x, y, m, resolution):
+    """Same as lut_init() in spline.c, None if the curve can't have one."""
+    if resolution <= 0 or x[0] <= 0.0:
+        return None
+
+    start = float(math.floor(lut_log2(x[0])))
+    size = math.ceil(f32(f32(lut_log2(x[-1]) - start) * resolution)) + 1
+    first = math.ceil(f32(f32(lut_log2(x[0]) - start) * resolution))
+    last = math.floor(f32(f32(lut_log2(x[-1]) - start) * resolution))
+
+    def pos(i):
+        return f32(start + f32(f32(i) / resolution))
+
+    lut = [f32(interpolate(x, y, m, lut_exp2(pos(i)))) for i in range(size)]
+
+    error = 0.0
+    j = 0
+    for i in range(first, last):
+        a = lut_exp2(pos(i))
+        b = lut_exp2(pos(i + 1))
+        while j < len(x) - 2 and x[j + 1] <= a:
+            j += 1
+        cell = lut_cell_error(x, y, m, j, a, b)
+        cell += LUT_ROUNDING * max(abs(lut[i]), abs(lut[i + 1]))
+        error = max(error, cell)
+
+    return {
+        "lut": lut,
+        "start": start,
+        "first": first,
+        "last": last,
+        "error": f32(error),
+    }
+
+
+def fits_b16(x, y):
+    return all(abs(v) <= B16_X_MAX for v in x) and all(
+        abs(v) <= B16_Y_MAX for v in y
+    )
+
+
+def write_header(out, source, x, y, m, mid, table):
+    n = len(x)
+    w = out.write
+
+    w("/* Generated by tools/gencurve.py from %s, do not edit. */\n\n" % source)
+    w("#ifndef _BRIGHTNESS_DEFAULT_CURVE_H\n")
+    w("#define _BRIGHTNESS_DEFAULT_CURVE_H\n\n")
+    w('#include "spline.h"\n\n')
+
+    w("/**\n * {lux, backlight}\n */\n")
+    for name, values in (("lux", x), ("power", y)):
+        w("static const float default_curve_%s[] = {\n" % name)
+        for v in values:
+            w("    %s,\n" % cfloat(v))
+        w("};\n\n")
+
+    w("static const struct spline_knot_s default_curve_knots[] = {\n")
+    for i in range(n):
+        w("    {\n")
+        w("        .x = %s,\n" % cfloat(x[i]))
+        w("        .y = %s,\n" % cfloat(y[i]))
+        w("        .m = %s,\n" % cfloat(m[i]))
+        w("        .mid = %s,\n" % cfloat(mid[i]))
+        if fits_b16(x, y):
+            w("#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT\n")
+            w("        .bx = %d,\n" % b16(x[i]))
+            w("        .by = %d,\n" % b16(y[i]))
+            if i + 1 < n:
+                h = f32(x[i + 1] - x[i])
+                w("        .bhm0 = %d,\n" % b16(f32(h * m[i])))
+                w("        .bhm1 = %d,\n" % b16(f32(h * m[i + 1])))
+            w("#endif\n")
+        w("    },\n")
+    w("};\n\n")
+
+    if not fits_b16(x, y):
+        w("#ifdef CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT\n")
+        w('#error "Default curve is out of fixed-point range"\n')
+        w("#endif\n\n")
+
+    if table:
+        w("static const float default_curve_lut[] = {\n")
+        for v in table["lut"]:
+            w("    %s,\n" % cfloat(v))
+        w("};\n\n")
+
+    w("/* Ready to use, read-only splines are never written to. */\n")
+    w("static const struct spline_s default_curve = {\n")
+    w("    .knots = (struct spline_knot_s *)default_curve_knots,\n")
+    w("    .n = %d,\n" % n)
+    w("    .capacity = %d,\n" % n)
+    w("    .type = SPLINE_TYPE_MONOTONE_CUBIC,\n")
+    w("    .readonly = true,\n")
+    if table:
+        w("    .lut = (float *)default_curve_lut,\n")
+        w("    .lut_storage = (float *)default_curve_lut,\n")
+        w("    .lut_capacity = %d,\n" % len(table["lut"]))
+        w("    .lut_size = %d,\n" % len(table["lut"]))
+        w("    .lut_start = %s,\n" % cfloat(table["start"]))
+        w("    .lut_first = %d,\n" % table["first"])
+        w("    .lut_last = %d,\n" % table["last"])
+        w("    .lut_error = %s,\n" % cfloat(table["error"]))
+    w("};\n\n")
+    w("#endif\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("curve", help="curve file")
+    parser.add_argument("output", help="header to generate")
+    parser.add_argument(
+        "--lut-resolution",
+        type=int,
+        default=0,
+        help="lookup table entries per octave, "
+        "CONFIG_BRIGHTNESS_SPLINE_LUT_RESOLUTION",
+    )
+    args = parser.parse_args()
+
+    x, y = parse_curve(args.curve)
+    m, mid = monotone_cubic_tangents(x, y)
+    table = lookup_table(x, y, m, args.lut_resolution)
+
+    tmp = args.output + ".tmp"
+    with open(tmp, "w") as out:
+        write_header(out, os.path.basename(args.curve), x, y, m, mid, table)
+    os.replace(tmp, args.output)
+
+
+if __name__ == "__main__":
+    main()
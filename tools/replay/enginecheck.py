@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2024 Xiaomi Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""
+Check the fixed-point engine against the float engine.
+
+One generated lux trace, with user adjustments, is replayed through a float
+and a CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT build of the replay tool. That
+runs the lux filters, the adjustment gamma and the curve of each engine.
+At every brightness target either of them picks, the targets they hold
+must be within the documented tolerance of 1 level.
+
+A brightness drag is held until the curve gives a new level, so a level
+one engine rounds down and the other doesn't can keep the drag on one of
+them. Such times are skipped, the drag is not a level of the engine.
+"""
+
+import argparse
+import bisect
+import math
+import random
+import subprocess
+import sys
+
+TOLERANCE = 1  # Levels, see CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT
+
+SAMPLE_US = 200000  # 5 Hz sensor
+HOURS = 4
+LUX_MIN = 0.5
+LUX_MAX = 20000.0  # Below the Q16 lux clamp
+NOISE = 0.05  # Well inside the 20% jitter threshold
+
+
+def next_scene(rng, lux):
+    """Step far past the 60% brighten and darken thresholds, and clear of
+    the 8 times fast threshold, so both engines take it at the same
+    sample."""
+    for _ in range(100):
+        if rng.random() < 0.5:
+            factor = rng.choice([rng.uniform(2.5, 5.0), rng.uniform(12.0, 50.0)])
+        else:
+            factor = 1.0 / rng.uniform(3.5, 50.0)
+
+        if LUX_MIN <= lux * factor <= LUX_MAX:
+            return lux * factor
+
+    return lux
+
+
+def generate(seed):
+    """Scenes of steady lux with sample noise, 30 s to 10 min each. Halfway
+    through some of them, the user drags the brightness or sets a point."""
+    rng = random.Random(seed)
+    lines = []
+    lux = 300.0
+    time = 1000000
+
+    while time < HOURS * 3600 * 1000000:
+        samples = rng.randint(30, 600) * 1000000 // SAMPLE_US
+        event = rng.choice([None, None, "target", "user"])
+        for i in range(samples):
+            sample = lux * (1.0 + rng.uniform(-NOISE, NOISE))
+            lines.append("%d %.2f" % (time, sample))
+            if i == samples // 2 and event == "target":
+                lines.append("%d target %d" % (time + 1, rng.randint(10, 255)))
+            elif i == samples // 2 and event == "user":
+                point = math.exp(rng.uniform(0.0, math.log(5000.0)))
+                level = rng.randint(1, 255)
+                lines.append("%d user %d %d" % (time + 1, point, level))
+
+            time += SAMPLE_US
+
+        lux = next_scene(rng, lux)
+
+    return "\n".join(lines) + "\n"
+
+
+def drags(trace):
+    """Times in ms and levels of the brightness drags of a trace."""
+    held = set()
+    for line in trace.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] == "target":
+            held.add((int(fields[0]) // 1000, int(fields[2])))
+
+    return held
+
+
+def targets(replay, trace):
+    out = subprocess.run(
+        [replay, "-"],
+        input=trace,
+        capture_output=True,
+        text=True,
+        check=True,
+    ).stdout
+
+    events = []
+    for line in out.splitlines():
+        time, event, level = line.split(",")
+        if event == "target":
+            events.append((int(time), int(level)))
+
+    return events
+
+
+def held_at(events, times, time):
+    """Target held at 'time', or None before the first one."""
+    i = bisect.bisect_right(times, time) - 1
+    return events[i] if i >= 0 else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("float_replay", help="replay tool of the float engine")
+    parser.add_argument("fixed_replay", help="replay tool of the Q16 engine")
+    parser.add_argument("--seed", type=int, default=1, help="trace seed")
+    args = parser.parse_args()
+
+    trace = generate(args.seed)
+    held = drags(trace)
+    expect = targets(args.float_replay, trace)
+    actual = targets(args.fixed_replay, trace)
+    expect_times = [t for t, _ in expect]
+    actual_times = [t for t, _ in actual]
+
+    worst = 0
+    for time in sorted(set(expect_times + actual_times)):
+        a = held_at(expect, expect_times, time)
+        b = held_at(actual, actual_times, time)
+        if a is None or b is None or (a in held) != (b in held):
+            continue
+
+        worst = max(worst, abs(a[1] - b[1]))
+        if abs(a[1] - b[1]) > TOLERANCE:
+            print(
+                "At %d ms float holds level %d, fixed-point %d"
+                % (time, a[1], b[1]),
+                file=sys.stderr,
+            )
+            return 1
+
+    print(
+        "%d and %d targets, levels differ by at most %d"
+        % (len(expect), len(actual), worst)
+    )
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
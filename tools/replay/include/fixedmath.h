@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The Q16 subset of NuttX fixedmath.h used with
+ * CONFIG_BRIGHTNESS_SERVICE_FIXEDPOINT, with the same results.
+ */
+
+#ifndef _REPLAY_FIXEDMATH_H
+#define _REPLAY_FIXEDMATH_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* clang-format off */
+#define b16ONE              0x00010000
+#define b16HALF             0x00008000
+#define b16MAX              0x7fffffff
+#define b16MIN              ((b16_t)0x80000000)
+
+#define itob16(i)           (((b16_t)(i)) << 16)
+#define b16toi(a)           ((a) >> 16)
+#define b16tof(b)           (((float)(b)) / 65536.0f)
+#define ftob16(f)           ((b16_t)((f) * 65536.0f))
+#define b16mulb16(a, b)     ((b16_t)(((int64_t)(a) * (int64_t)(b)) >> 16))
+#define b16divb16(a, b)     ((b16_t)((int64_t)(a) * b16ONE / (b)))
+/* clang-format on */
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef int32_t b16_t;
+typedef uint32_t ub16_t;
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Configuration and NuttX definitions of the host replay build. It is
+ * included ahead of every source, options are set from the command line,
+ * e.g. make CONFIG="-DCONFIG_LIGHTSENSOR_FREQUENCY=10".
+ */
+
+#ifndef _REPLAY_NUTTX_CONFIG_H
+#define _REPLAY_NUTTX_CONFIG_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <syslog.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Kconfig defaults */
+
+#ifndef CONFIG_BACKLIGHT_LEVEL_MIN
+#define CONFIG_BACKLIGHT_LEVEL_MIN 1
+#endif
+
+#ifndef CONFIG_BACKLIGHT_LEVEL_MAX
+#define CONFIG_BACKLIGHT_LEVEL_MAX 255
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_FREQUENCY
+#define CONFIG_LIGHTSENSOR_FREQUENCY 5
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_IDLE_FREQUENCY
+#define CONFIG_LIGHTSENSOR_IDLE_FREQUENCY 1
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_IDLE_TIME
+#define CONFIG_LIGHTSENSOR_IDLE_TIME 10000
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_SMOOTHING_TIME
+#define CONFIG_LIGHTSENSOR_SMOOTHING_TIME 1800
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_BRIGHTEN_TIME
+#define CONFIG_LIGHTSENSOR_BRIGHTEN_TIME 2000
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_DARKEN_TIME
+#define CONFIG_LIGHTSENSOR_DARKEN_TIME 2000
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_BRIGHTEN_THRESHOLD
+#define CONFIG_LIGHTSENSOR_BRIGHTEN_THRESHOLD 60
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_DARKEN_THRESHOLD
+#define CONFIG_LIGHTSENSOR_DARKEN_THRESHOLD 60
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_FAST_THRESHOLD
+#define CONFIG_LIGHTSENSOR_FAST_THRESHOLD 700
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_FAST_TIME
+#define CONFIG_LIGHTSENSOR_FAST_TIME 400
+#endif
+
+#ifndef CONFIG_LIGHTSENSOR_FAST_RAMP
+#define CONFIG_LIGHTSENSOR_FAST_RAMP 250
+#endif
+
+#ifndef CONFIG_BRIGHTNESS_USER_POINTS
+#define CONFIG_BRIGHTNESS_USER_POINTS 5
+#endif
+
+#ifndef CONFIG_BRIGHTNESS_SERVICE_DEFAULT_DEVICE
+#define CONFIG_BRIGHTNESS_SERVICE_DEFAULT_DEVICE "/dev/fb0"
+#endif
+
+/* NuttX definitions the service relies on */
+
+#define OK 0
+#define ERROR -1
+#define FAR
+#define DEBUGASSERT(f) assert(f)
+
+#ifndef nitems
+#define nitems(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define zalloc(size) calloc(1, size)
+
+/* Logs go to stderr with -v instead of the host syslog. */
+#define syslog(...) replay_syslog(__VA_ARGS__)
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void replay_syslog(int priority, const char *format, ...);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Frame buffer backlight, the device calls of display.c are routed to the
+ * replay, which records each write.
+ */
+
+#ifndef _REPLAY_NUTTX_VIDEO_FB_H
+#define _REPLAY_NUTTX_VIDEO_FB_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define _FBIOC(nr) (0x2800 | (nr))
+
+#define FBIOSET_POWER 0x2801
+#define FBIOGET_POWER 0x2802
+
+#define open(...) replay_open(__VA_ARGS__)
+#define ioctl(...) replay_ioctl(__VA_ARGS__)
+#define close(...) replay_close(__VA_ARGS__)
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int replay_open(const char *path, int oflags, ...);
+int replay_ioctl(int fd, int req, ...);
+int replay_close(int fd);
+
+#endif
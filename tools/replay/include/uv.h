@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The part of libuv used by the service, on a virtual clock. Time only
+ * moves when the replay advances it, so timers fire as fast as the CPU
+ * allows, in the same order as they would on the device.
+ */
+
+#ifndef _REPLAY_UV_H
+#define _REPLAY_UV_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define UV_HANDLE_FIELDS                                                       \
+    void *data;                                                                \
+    uv_loop_t *loop;                                                           \
+    uintptr_t flags;                                                           \
+    int type;                                                                  \
+    bool closing;                                                              \
+    uv_close_cb close_cb;                                                      \
+    struct uv_handle_s *next_closing;
+
+#define UV_REQ_FIELDS                                                          \
+    void *data;                                                                \
+    int type;
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef struct uv_loop_s uv_loop_t;
+typedef struct uv_handle_s uv_handle_t;
+typedef struct uv_timer_s uv_timer_t;
+typedef struct uv_req_s uv_req_t;
+typedef struct uv_work_s uv_work_t;
+
+typedef void (*uv_close_cb)(uv_handle_t *handle);
+typedef void (*uv_timer_cb)(uv_timer_t *handle);
+typedef void (*uv_work_cb)(uv_work_t *req);
+typedef void (*uv_after_work_cb)(uv_work_t *req, int status);
+
+typedef enum {
+    UV_RUN_DEFAULT = 0,
+    UV_RUN_ONCE,
+    UV_RUN_NOWAIT,
+} uv_run_mode;
+
+enum {
+    UV_TIMER = 1,
+    UV_TOPIC,
+};
+
+enum {
+    UV_WORK = 1,
+};
+
+struct uv_loop_s {
+    void *data;
+    uint64_t time;     /* Virtual time in ms */
+    uint64_t timer_id; /* Start order of timers due at the same time */
+    struct uv_timer_s *timers;
+    struct uv_topic_s *topics;
+    struct uv_handle_s *closing;
+    struct uv_work_s *done; /* Work waiting for its after work callback */
+    unsigned long wakeups;  /* Timer callbacks run */
+};
+
+struct uv_handle_s {
+    UV_HANDLE_FIELDS
+};
+
+struct uv_timer_s {
+    UV_HANDLE_FIELDS
+    uv_timer_cb timer_cb;
+    uint64_t timeout;
+    uint64_t repeat;
+    uint64_t start_id;
+    bool active;
+    struct uv_timer_s *next_timer;
+};
+
+struct uv_req_s {
+    UV_REQ_FIELDS
+};
+
+struct uv_work_s {
+    UV_REQ_FIELDS
+    uv_loop_t *loop;
+    uv_work_cb work_cb;
+    uv_after_work_cb after_work_cb;
+    struct uv_work_s *next_done;
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int uv_loop_init(uv_loop_t *loop);
+int uv_loop_close(uv_loop_t *loop);
+
+/**
+ * UV_RUN_DEFAULT runs until no timer is active, moving the clock to each
+ * timer as it fires. UV_RUN_NOWAIT only runs what is due now.
+ */
+int uv_run(uv_loop_t *loop, uv_run_mode mode);
+
+uint64_t uv_now(const uv_loop_t *loop);
+void uv_update_time(uv_loop_t *loop);
+
+int uv_timer_init(uv_loop_t *loop, uv_timer_t *handle);
+int uv_timer_start(uv_timer_t *handle, uv_timer_cb cb, uint64_t timeout,
+                   uint64_t repeat);
+int uv_timer_stop(uv_timer_t *handle);
+
+void uv_close(uv_handle_t *handle, uv_close_cb close_cb);
+
+/**
+ * Work runs at once, the worker takes no virtual time. The after work
+ * callback comes from the loop, like it would after a worker thread.
+ */
+int uv_queue_work(uv_loop_t *loop, uv_work_t *req, uv_work_cb work_cb,
+                  uv_after_work_cb after_work_cb);
+int uv_cancel(uv_req_t *req);
+
+/**
+ * @brief Run the loop up to a point in virtual time
+ * @param loop The loop
+ * @param time Time in ms, timers due until then fire in order
+ */
+void uv_replay_advance(uv_loop_t *loop, uint64_t time);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * uORB topic handles, samples are published by the replay instead of
+ * sensor drivers.
+ */
+
+#ifndef _REPLAY_UV_EXT_H
+#define _REPLAY_UV_EXT_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <uv.h>
+
+#include <uORB/uORB.h>
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+typedef struct uv_topic_s uv_topic_t;
+
+typedef void (*uv_topic_cb)(uv_topic_t *topic, int status, void *data,
+                            size_t datalen);
+
+struct uv_topic_s {
+    UV_HANDLE_FIELDS
+    uv_topic_cb topic_cb;
+    orb_id_t meta;
+    unsigned int frequency;
+    struct uv_topic_s *next_topic;
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int uv_topic_subscribe(uv_loop_t *loop, uv_topic_t *topic, orb_id_t meta,
+                       uv_topic_cb cb);
+int uv_topic_unsubscribe(uv_topic_t *topic);
+int uv_topic_set_frequency(uv_topic_t *topic, unsigned int frequency);
+
+/**
+ * @brief Deliver data to all subscribers of a topic
+ * @param loop The loop
+ * @param meta Topic
+ * @param data Samples
+ * @param datalen Size of samples in bytes
+ * @return Number of subscribers
+ */
+int uv_replay_publish(uv_loop_t *loop, orb_id_t meta, void *data,
+                      size_t datalen);
+
+/**
+ * @brief Highest sample rate the subscribers of a topic asked for, which
+ *        the sensor driver would run at
+ * @param loop The loop
+ * @param meta Topic
+ * @return Rate in Hz, 0 if there is no subscriber or none set a rate
+ */
+unsigned int uv_replay_frequency(uv_loop_t *loop, orb_id_t meta);
+
+#endif
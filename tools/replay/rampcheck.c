@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Check the backlight writes of display ramps on a mock display, on the
+ * virtual clock of the replay loop. Each case ramps once and checks that
+ * levels only move towards the target, at most once per timer period,
+ * every level is written if the ramp is slow enough, and the ramp ends on
+ * time. Exits with failure on the first case that does not hold.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/param.h>
+
+#include <uv.h>
+
+#include "display.h"
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct ramp_case_s {
+    int from;
+    int to;
+    int ramp; /* Levels per second */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* clang-format off */
+static const struct ramp_case_s g_ramp_cases[] = {
+    { 10,  200, 190 },
+    { 200, 10,  190 },
+    { 1,   255, 5   },
+    { 255, 1,   250 },
+    { 100, 101, 50  },
+    { 100, 100, 50  },
+};
+/* clang-format on */
+
+static const char *const g_curve_names[] = {
+    [DISPLAY_RAMP_LINEAR] = "linear",
+    [DISPLAY_RAMP_PERCEPTUAL] = "perceptual",
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void fail(const struct ramp_case_s *c, enum display_ramp_curve_e curve,
+                 const char *format, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%d -> %d at %d/s, %s: ", c->from, c->to, c->ramp,
+            g_curve_names[curve]);
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+static void check_ramp(const struct ramp_case_s *c,
+                       enum display_ramp_curve_e curve)
+{
+    struct display_mock_write_s writes[DISPLAY_MOCK_WRITES_MAX];
+    struct display_mock_write_s *last;
+    struct display_brightness_s *display;
+    int step = c->to > c->from ? 1 : -1;
+    int distance = abs(c->to - c->from);
+    char path[32];
+    uint64_t start;
+    uint64_t end;
+    uv_loop_t loop;
+    int limit;
+    int n;
+    int i;
+
+    uv_loop_init(&loop);
+    snprintf(path, sizeof(path), "mock:%d", c->from);
+    display = display_brightness_open_device(path, &loop);
+    if (display == NULL) {
+        fail(c, curve, "failed to open %s\n", path);
+    }
+
+    start = uv_now(&loop);
+    display_brightness_set(display, c->to, c->ramp, curve);
+    display_brightness_get_ramp_end(display, &end);
+    uv_run(&loop, UV_RUN_DEFAULT);
+
+    n = display_mock_get_writes(display, writes, nitems(writes));
+    limit = MIN(distance,
+                (end - start) / DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD + 1);
+    if (n > limit) {
+        fail(c, curve, "%d writes, limit %d\n", n, limit);
+    }
+
+    /* Slow enough for one write per level, none may be skipped. */
+    if (curve == DISPLAY_RAMP_LINEAR &&
+        c->ramp * DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD <= 1000 &&
+        n != distance) {
+        fail(c, curve, "%d writes for %d levels\n", n, distance);
+    }
+
+    for (i = 0; i < n; i++) {
+        int last = i > 0 ? writes[i - 1].level : c->from;
+        uint64_t time = i > 0 ? writes[i - 1].time
+                              : start - DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD;
+
+        if ((writes[i].level - last) * step <= 0 ||
+            writes[i].time < time + DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD) {
+            fail(c, curve, "write %d of level %d at %" PRIu64 " ms\n", i,
+                 writes[i].level, writes[i].time - start);
+        }
+    }
+
+    last = n > 0 ? &writes[n - 1] : NULL;
+    if (distance > 0 &&
+        (last == NULL || last->level != c->to ||
+         last->time > end + DISPLAY_BRIGHTNESS_RAMP_TIMER_PERIOD)) {
+        fail(c, curve, "ended at level %d, %" PRIu64 " ms, planned %" PRIu64
+                       " ms\n",
+             last ? last->level : c->from, last ? last->time - start : 0,
+             end - start);
+    }
+
+    printf("%d -> %d at %d/s, %s: %d writes in %" PRIu64 " ms\n", c->from,
+           c->to, c->ramp, g_curve_names[curve], n,
+           last ? last->time - start : 0);
+
+    display_brightness_close_device(display);
+    uv_run(&loop, UV_RUN_NOWAIT);
+    uv_loop_close(&loop);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/* Only the mock display is opened, the fb device calls never happen. */
+
+void replay_syslog(int priority, const char *format, ...)
+{
+}
+
+int replay_open(const char *path, int oflags, ...)
+{
+    errno = ENODEV;
+    return ERROR;
+}
+
+int replay_ioctl(int fd, int req, ...)
+{
+    errno = EBADF;
+    return ERROR;
+}
+
+int replay_close(int fd)
+{
+    return OK;
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < nitems(g_ramp_cases); i++) {
+        check_ramp(&g_ramp_cases[i], DISPLAY_RAMP_LINEAR);
+        check_ramp(&g_ramp_cases[i], DISPLAY_RAMP_PERCEPTUAL);
+    }
+
+    return EXIT_SUCCESS;
+}
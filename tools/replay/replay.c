@@ -0,0 +1,508 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Replay a recorded light sensor trace through the auto brightness
+ * controller on a virtual clock, and print what it does with the backlight.
+ *
+ * The trace has one event per line, time in microseconds first:
+ *   <time> <lux>              light sensor sample
+ *   <time> target <level>     user drags the brightness, abc_set_target()
+ *   <time> user <lux> <level> user point is set, abc_set_user_point()
+ *   <time> off                display turns off, the service pauses abc
+ *   <time> on                 display turns back on
+ *   <time> manual             user leaves auto mode, abc goes dormant
+ *   <time> auto               user goes back to auto mode
+ * Fields are separated by spaces or a comma, text after '#' is a comment.
+ *
+ * Samples closer than the sensor rate the service asks for are skipped, as
+ * the sensor would not take them, and so are all while nobody subscribes.
+ *
+ * The output is CSV, "time_ms,event,level". Events are "target" when the
+ * controller picks a new brightness, and "write" for each backlight write,
+ * including the ones of a ramp. With --fade, in a build with
+ * CONFIG_BRIGHTNESS_DISPLAY_FADE, the fake backlight fades on its own, and
+ * a "fade" to the target level replaces the writes of a linear ramp.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include <nuttx/video/fb.h>
+#include <uv.h>
+#include <uv_ext.h>
+
+#include "abc.h"
+#include "display.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define REPLAY_FB_FD 3 /* Any valid looking descriptor */
+#define REPLAY_LINE_MAX 256
+#define REPLAY_BATCH_MAX 64
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct replay_s {
+    uv_loop_t loop;
+    struct display_brightness_s *display;
+    FILE *out;
+    bool verbose;
+    int backlight; /* Level the fake backlight holds, or fades from */
+    bool has_fade; /* Fake backlight takes FBIOSET_FADE */
+    struct display_fade_s fade; /* Fade in progress */
+    uint64_t fade_start; /* in ms */
+    uint64_t latency; /* Batch latency in us, 0 to deliver each sample */
+    struct sensor_light batch[REPLAY_BATCH_MAX];
+    int batched;
+    uint64_t first; /* Time span of the trace in us */
+    uint64_t last;
+    uint64_t sampled; /* Last sample the sensor took in us, 0 if none */
+
+    unsigned long samples;
+    unsigned long delivered;
+    unsigned long targets;
+    unsigned long writes;
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+/* abc.c is built with display_brightness_set() renamed to this. */
+int replay_brightness_set(struct display_brightness_s *display, int brightness,
+                          int ramp, enum display_ramp_curve_e curve);
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+const struct orb_metadata g_orb_sensor_light = {
+    "sensor_light",
+    sizeof(struct sensor_light),
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct replay_s g_replay;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t wall_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void output(const char *event, int level)
+{
+    fprintf(g_replay.out, "%" PRIu64 ",%s,%d\n", uv_now(&g_replay.loop),
+            event, level);
+}
+
+/* Level of the fake backlight now, part way through a fade. */
+static int backlight_level(void)
+{
+    uint64_t elapsed = uv_now(&g_replay.loop) - g_replay.fade_start;
+
+    if (elapsed >= g_replay.fade.duration) {
+        return g_replay.fade.level;
+    }
+
+    return g_replay.backlight + (g_replay.fade.level - g_replay.backlight) *
+                                    (int)elapsed /
+                                    (int)g_replay.fade.duration;
+}
+
+/* Deliver batched samples, as the sensor does once its latency expires. */
+static void flush_batch(void)
+{
+    if (g_replay.batched == 0) {
+        return;
+    }
+
+    uv_replay_publish(&g_replay.loop, ORB_ID(sensor_light), g_replay.batch,
+                      g_replay.batched * sizeof(struct sensor_light));
+    g_replay.batched = 0;
+}
+
+static void advance(uint64_t timestamp)
+{
+    uint64_t due;
+
+    if (g_replay.batched > 0) {
+        due = g_replay.batch[0].timestamp + g_replay.latency;
+        if (timestamp >= due) {
+            uv_replay_advance(&g_replay.loop, due / 1000);
+            flush_batch();
+        }
+    }
+
+    uv_replay_advance(&g_replay.loop, timestamp / 1000);
+}
+
+/* Sensor running at the requested rate, with a quarter period of slack for
+ * trace timestamps, takes a sample only once a period. */
+static bool sensor_takes(uint64_t timestamp)
+{
+    unsigned int frequency =
+        uv_replay_frequency(&g_replay.loop, ORB_ID(sensor_light));
+
+    if (frequency == 0 || (g_replay.sampled > 0 &&
+                           timestamp - g_replay.sampled < 750000 / frequency)) {
+        return false;
+    }
+
+    g_replay.sampled = timestamp;
+    return true;
+}
+
+static int replay_line(struct abc_s *abc, const char *path, int lineno,
+                       char *line)
+{
+    struct sensor_light *sample;
+    char *fields[4];
+    uint64_t timestamp;
+    char *end;
+    int n = 0;
+
+    line[strcspn(line, "#\r\n")] = '\0';
+    for (char *p = strtok(line, " \t,"); p; p = strtok(NULL, " \t,")) {
+        if (n == nitems(fields)) {
+            goto invalid;
+        }
+
+        fields[n++] = p;
+    }
+
+    if (n == 0) {
+        return OK;
+    }
+
+    errno = 0;
+    timestamp = strtoull(fields[0], &end, 10);
+    if (errno || *end != '\0' || n < 2) {
+        goto invalid;
+    }
+
+    if (timestamp < g_replay.last) {
+        fprintf(stderr, "%s:%d: time goes backwards\n", path, lineno);
+        return ERROR;
+    }
+
+    g_replay.first = MIN(g_replay.first, timestamp);
+    g_replay.last = timestamp;
+    advance(timestamp);
+
+    if (strcmp(fields[1], "target") == 0 && n == 3) {
+        flush_batch();
+        abc_set_target(abc, atoi(fields[2]), BRIGHTNESS_RAMP_SPEED_DEFAULT);
+    } else if (strcmp(fields[1], "off") == 0 && n == 2) {
+        /* As the service does for BRIGHTNESS_LEVEL_OFF in auto mode */
+        flush_batch();
+        abc_pause(abc, ABC_PAUSE_DISPLAY_OFF);
+        display_brightness_set(g_replay.display, BRIGHTNESS_LEVEL_OFF,
+                               BRIGHTNESS_RAMP_SPEED_OFF, DISPLAY_RAMP_LINEAR);
+    } else if (strcmp(fields[1], "on") == 0 && n == 2) {
+        flush_batch();
+        abc_resume(abc, ABC_PAUSE_DISPLAY_OFF);
+    } else if (strcmp(fields[1], "manual") == 0 && n == 2) {
+        flush_batch();
+        abc_pause(abc, ABC_PAUSE_MANUAL);
+    } else if (strcmp(fields[1], "auto") == 0 && n == 2) {
+        flush_batch();
+        abc_resume(abc, ABC_PAUSE_MANUAL);
+    } else if (strcmp(fields[1], "user") == 0 && n == 4) {
+        flush_batch();
+        abc_set_user_point(abc, atoi(fields[2]), atoi(fields[3]));
+    } else if (n == 2) {
+        g_replay.samples++;
+        if (!sensor_takes(timestamp)) {
+            return OK;
+        }
+
+        sample = &g_replay.batch[g_replay.batched];
+        memset(sample, 0, sizeof(*sample));
+        sample->timestamp = timestamp;
+        sample->light = strtof(fields[1], &end);
+        if (*end != '\0') {
+            goto invalid;
+        }
+
+        g_replay.batched++;
+        g_replay.delivered++;
+        if (g_replay.latency == 0 || g_replay.batched == REPLAY_BATCH_MAX) {
+            flush_batch();
+        }
+    } else {
+        goto invalid;
+    }
+
+    return OK;
+
+invalid:
+    fprintf(stderr, "%s:%d: invalid event\n", path, lineno);
+    return ERROR;
+}
+
+static int replay_trace(struct abc_s *abc, const char *path, FILE *trace)
+{
+    char line[REPLAY_LINE_MAX];
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), trace)) {
+        lineno++;
+        if (replay_line(abc, path, lineno, line) < 0) {
+            return ERROR;
+        }
+    }
+
+    /* Let the last batch, ramp and interactive model finish. */
+    if (g_replay.batched > 0) {
+        advance(g_replay.batch[0].timestamp + g_replay.latency);
+    }
+
+    uv_run(&g_replay.loop, UV_RUN_DEFAULT);
+    return OK;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "replay - replay a light sensor trace through auto brightness.\n\n"
+            "Usage: replay [options] <trace>, '-' reads stdin\n"
+            "  -o, --output <file>    Output file, default stdout\n"
+            "  -b, --backlight <lvl>  Initial backlight level, default %d\n"
+            "  -l, --latency <ms>     Deliver samples in batches, as with\n"
+            "                         sensor batch latency, default 0\n"
+            "  -f, --fade             Backlight fades on its own\n"
+            "  -v, --verbose          Print service logs to stderr\n",
+            BACKLIGHT_LEVEL_MAX / 2);
+}
+
+/* clang-format off */
+static const struct option options[] = {
+    {"output", required_argument, NULL, 'o'},
+    {"backlight", required_argument, NULL, 'b'},
+    {"latency", required_argument, NULL, 'l'},
+    {"fade", no_argument, NULL, 'f'},
+    {"verbose", no_argument, NULL, 'v'},
+    {"help", no_argument, NULL, 'h'},
+
+    {NULL},
+};
+/* clang-format on */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void replay_syslog(int priority, const char *format, ...)
+{
+    va_list ap;
+
+    if (!g_replay.verbose) {
+        return;
+    }
+
+    fprintf(stderr, "[%" PRIu64 "] ", uv_now(&g_replay.loop));
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+int replay_open(const char *path, int oflags, ...)
+{
+    return REPLAY_FB_FD;
+}
+
+int replay_ioctl(int fd, int req, ...)
+{
+    struct display_fade_s *fade;
+    va_list ap;
+    int ret = OK;
+
+    va_start(ap, req);
+    if (fd != REPLAY_FB_FD) {
+        ret = -EBADF;
+    } else if (req == FBIOGET_POWER) {
+        *va_arg(ap, int *) = backlight_level();
+    } else if (req == FBIOSET_POWER) {
+        g_replay.backlight = va_arg(ap, int);
+        g_replay.fade.level = g_replay.backlight;
+        g_replay.fade.duration = 0;
+        g_replay.writes++;
+        output("write", g_replay.backlight);
+    } else if (req == FBIOSET_FADE && g_replay.has_fade) {
+        g_replay.backlight = backlight_level();
+        g_replay.fade = *va_arg(ap, struct display_fade_s *);
+        g_replay.fade_start = uv_now(&g_replay.loop);
+        g_replay.writes++;
+        output("fade", g_replay.fade.level);
+    } else if (req == FBIOGET_FADE && g_replay.has_fade) {
+        fade = va_arg(ap, struct display_fade_s *);
+        fade->level = g_replay.fade.level;
+        fade->duration =
+            g_replay.fade.duration -
+            MIN(uv_now(&g_replay.loop) - g_replay.fade_start,
+                g_replay.fade.duration);
+    } else {
+        ret = -ENOTTY;
+    }
+
+    va_end(ap);
+    if (ret < 0) {
+        errno = -ret;
+        return ERROR;
+    }
+
+    return OK;
+}
+
+int replay_close(int fd)
+{
+    return fd == REPLAY_FB_FD ? OK : -EBADF;
+}
+
+int replay_brightness_set(struct display_brightness_s *display, int brightness,
+                          int ramp, enum display_ramp_curve_e curve)
+{
+    g_replay.targets++;
+    output("target", brightness);
+    return display_brightness_set(display, brightness, ramp, curve);
+}
+
+int main(int argc, char **argv)
+{
+    struct display_brightness_s *display;
+    struct abc_s *abc;
+    const char *path;
+    FILE *trace;
+    uint64_t start;
+    int ret;
+    int c;
+
+    g_replay.out = stdout;
+    g_replay.backlight = BACKLIGHT_LEVEL_MAX / 2;
+    g_replay.first = UINT64_MAX;
+
+    while ((c = getopt_long(argc, argv, "o:b:l:fvh", options, NULL)) >= 0) {
+        switch (c) {
+        case 'o':
+            g_replay.out = fopen(optarg, "w");
+            if (g_replay.out == NULL) {
+                fprintf(stderr, "Failed to open %s, %d\n", optarg, errno);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            g_replay.backlight = atoi(optarg);
+            break;
+        case 'l':
+            g_replay.latency = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        case 'f':
+#ifdef CONFIG_BRIGHTNESS_DISPLAY_FADE
+            g_replay.has_fade = true;
+            break;
+#else
+            fprintf(stderr, "--fade needs CONFIG_BRIGHTNESS_DISPLAY_FADE\n");
+            exit(EXIT_FAILURE);
+#endif
+        case 'v':
+            g_replay.verbose = true;
+            break;
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    g_replay.fade.level = g_replay.backlight;
+    path = argv[optind];
+    trace = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (trace == NULL) {
+        fprintf(stderr, "Failed to open %s, %d\n", path, errno);
+        exit(EXIT_FAILURE);
+    }
+
+    uv_loop_init(&g_replay.loop);
+    display = display_brightness_open_device(
+        CONFIG_BRIGHTNESS_SERVICE_DEFAULT_DEVICE, &g_replay.loop);
+    g_replay.display = display;
+    abc = display ? abc_init(&g_replay.loop, display) : NULL;
+    if (abc == NULL) {
+        fprintf(stderr, "Failed to start the controller\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(g_replay.out, "time_ms,event,level\n");
+
+    start = wall_ms();
+    ret = replay_trace(abc, path, trace);
+
+    fprintf(stderr,
+            "%lu samples, %lu delivered, %.1f h of trace in %" PRIu64 " ms, "
+            "%lu targets, %lu writes, %lu timer wakeups\n",
+            g_replay.samples, g_replay.delivered,
+            (g_replay.last - MIN(g_replay.first, g_replay.last)) / 3.6e9,
+            wall_ms() - start, g_replay.targets, g_replay.writes,
+            g_replay.loop.wakeups);
+
+    abc_deinit(abc);
+    display_brightness_close_device(display);
+    uv_run(&g_replay.loop, UV_RUN_NOWAIT);
+    uv_loop_close(&g_replay.loop);
+
+    if (trace != stdin) {
+        fclose(trace);
+    }
+
+    if (g_replay.out != stdout) {
+        fclose(g_replay.out);
+    }
+
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
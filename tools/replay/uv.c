@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include <uv.h>
+#include <uv_ext.h>
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void handle_init(uv_loop_t *loop, uv_handle_t *handle, int type)
+{
+    memset(handle, 0, sizeof(*handle));
+    handle->loop = loop;
+    handle->type = type;
+}
+
+/* Active timer due first, ties fire in start order like libuv. */
+static uv_timer_t *next_timer(uv_loop_t *loop)
+{
+    uv_timer_t *next = NULL;
+
+    for (uv_timer_t *timer = loop->timers; timer; timer = timer->next_timer) {
+        if (!timer->active) {
+            continue;
+        }
+
+        if (next == NULL || timer->timeout < next->timeout ||
+            (timer->timeout == next->timeout &&
+             timer->start_id < next->start_id)) {
+            next = timer;
+        }
+    }
+
+    return next;
+}
+
+/* Work done callbacks, then close callbacks, in the order they came. */
+static void run_closing(uv_loop_t *loop)
+{
+    uv_handle_t *handle;
+    uv_work_t *req;
+
+    while ((req = loop->done) != NULL) {
+        loop->done = req->next_done;
+        req->after_work_cb(req, 0);
+    }
+
+    while ((handle = loop->closing) != NULL) {
+        loop->closing = handle->next_closing;
+        if (handle->close_cb) {
+            handle->close_cb(handle);
+        }
+    }
+}
+
+static void run_timer(uv_loop_t *loop, uv_timer_t *timer)
+{
+    loop->time = timer->timeout;
+    if (timer->repeat) {
+        timer->timeout = loop->time + timer->repeat;
+        timer->start_id = loop->timer_id++;
+    } else {
+        timer->active = false;
+    }
+
+    loop->wakeups++;
+    timer->timer_cb(timer);
+    run_closing(loop);
+}
+
+static void unlink_timer(uv_timer_t *timer)
+{
+    uv_timer_t **p = &timer->loop->timers;
+
+    while (*p && *p != timer) {
+        p = &(*p)->next_timer;
+    }
+
+    if (*p) {
+        *p = timer->next_timer;
+    }
+}
+
+static void unlink_topic(uv_topic_t *topic)
+{
+    uv_topic_t **p = &topic->loop->topics;
+
+    while (*p && *p != topic) {
+        p = &(*p)->next_topic;
+    }
+
+    if (*p) {
+        *p = topic->next_topic;
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int uv_loop_init(uv_loop_t *loop)
+{
+    memset(loop, 0, sizeof(*loop));
+    return 0;
+}
+
+int uv_loop_close(uv_loop_t *loop)
+{
+    run_closing(loop);
+    return loop->timers || loop->topics ? -EBUSY : 0;
+}
+
+int uv_run(uv_loop_t *loop, uv_run_mode mode)
+{
+    uv_timer_t *timer;
+
+    run_closing(loop);
+    while ((timer = next_timer(loop)) != NULL) {
+        if (mode != UV_RUN_DEFAULT && timer->timeout > loop->time) {
+            break;
+        }
+
+        run_timer(loop, timer);
+        if (mode == UV_RUN_ONCE) {
+            break;
+        }
+    }
+
+    return next_timer(loop) != NULL;
+}
+
+uint64_t uv_now(const uv_loop_t *loop)
+{
+    return loop->time;
+}
+
+void uv_update_time(uv_loop_t *loop)
+{
+    /* Virtual time only moves with uv_replay_advance() and timers. */
+}
+
+void uv_replay_advance(uv_loop_t *loop, uint64_t time)
+{
+    uv_timer_t *timer;
+
+    run_closing(loop);
+    while ((timer = next_timer(loop)) != NULL && timer->timeout <= time) {
+        run_timer(loop, timer);
+    }
+
+    if (time > loop->time) {
+        loop->time = time;
+    }
+}
+
+int uv_timer_init(uv_loop_t *loop, uv_timer_t *handle)
+{
+    memset(handle, 0, sizeof(*handle));
+    handle_init(loop, (uv_handle_t *)handle, UV_TIMER);
+    handle->next_timer = loop->timers;
+    loop->timers = handle;
+    return 0;
+}
+
+int uv_timer_start(uv_timer_t *handle, uv_timer_cb cb, uint64_t timeout,
+                   uint64_t repeat)
+{
+    if (handle->closing || cb == NULL) {
+        return -EINVAL;
+    }
+
+    handle->timer_cb = cb;
+    handle->timeout = handle->loop->time + timeout;
+    handle->repeat = repeat;
+    handle->start_id = handle->loop->timer_id++;
+    handle->active = true;
+    return 0;
+}
+
+int uv_timer_stop(uv_timer_t *handle)
+{
+    handle->active = false;
+    return 0;
+}
+
+int uv_queue_work(uv_loop_t *loop, uv_work_t *req, uv_work_cb work_cb,
+                  uv_after_work_cb after_work_cb)
+{
+    uv_work_t **p = &loop->done;
+
+    if (work_cb == NULL) {
+        return -EINVAL;
+    }
+
+    req->type = UV_WORK;
+    req->loop = loop;
+    req->work_cb = work_cb;
+    req->after_work_cb = after_work_cb;
+    req->next_done = NULL;
+    work_cb(req);
+
+    if (after_work_cb) {
+        while (*p) {
+            p = &(*p)->next_done;
+        }
+
+        *p = req;
+    }
+
+    return 0;
+}
+
+int uv_cancel(uv_req_t *req)
+{
+    /* Work has run already. */
+    return -EBUSY;
+}
+
+void uv_close(uv_handle_t *handle, uv_close_cb close_cb)
+{
+    uv_loop_t *loop = handle->loop;
+
+    if (handle->type == UV_TIMER) {
+        uv_timer_stop((uv_timer_t *)handle);
+        unlink_timer((uv_timer_t *)handle);
+    } else if (handle->type == UV_TOPIC) {
+        unlink_topic((uv_topic_t *)handle);
+    }
+
+    /* Callbacks run from the loop, as the handle may still be in use. */
+    handle->closing = true;
+    handle->close_cb = close_cb;
+    handle->next_closing = loop->closing;
+    loop->closing = handle;
+}
+
+int uv_topic_subscribe(uv_loop_t *loop, uv_topic_t *topic, orb_id_t meta,
+                       uv_topic_cb cb)
+{
+    memset(topic, 0, sizeof(*topic));
+    handle_init(loop, (uv_handle_t *)topic, UV_TOPIC);
+    topic->meta = meta;
+    topic->topic_cb = cb;
+    topic->next_topic = loop->topics;
+    loop->topics = topic;
+    return 0;
+}
+
+int uv_topic_unsubscribe(uv_topic_t *topic)
+{
+    unlink_topic(topic);
+    topic->topic_cb = NULL;
+    return 0;
+}
+
+int uv_topic_set_frequency(uv_topic_t *topic, unsigned int frequency)
+{
+    topic->frequency = frequency;
+    return 0;
+}
+
+int uv_replay_publish(uv_loop_t *loop, orb_id_t meta, void *data,
+                      size_t datalen)
+{
+    uv_topic_t *next;
+    int count = 0;
+
+    for (uv_topic_t *topic = loop->topics; topic; topic = next) {
+        next = topic->next_topic;
+        if (topic->meta == meta && topic->topic_cb) {
+            topic->topic_cb(topic, 0, data, datalen);
+            count++;
+        }
+    }
+
+    run_closing(loop);
+    return count;
+}
+
+unsigned int uv_replay_frequency(uv_loop_t *loop, orb_id_t meta)
+{
+    unsigned int frequency = 0;
+
+    for (uv_topic_t *topic = loop->topics; topic; topic = topic->next_topic) {
+        if (topic->meta == meta && topic->frequency > frequency) {
+            frequency = topic->frequency;
+        }
+    }
+
+    return frequency;
+}